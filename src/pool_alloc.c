@@ -6,206 +6,3806 @@
 
 #include "pool_alloc.h"
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 
-static uint8_t g_pool_heap[65536];
+/**
+ * State of a single allocator instance. Every heap is described by one of these,
+ * so any number of independent heaps may coexist within a process.
+ */
+struct pool_allocator
+{
+    uint8_t* heap;
+    size_t heap_size;
+    bool owns_heap;   // heap was mmap'd by the allocator and is unmapped on destroy
+    bool zeroed_heap; // heap held nothing but zeros when attached, so never handed out blocks still do
+    uint8_t* base_addr;
+    uint8_t* end_addr;
+    int num_pools;
+    size_t pool_size;
+    uint64_t pool_reciprocal; // divides offsets by pool_size (see divide_offset())
+    pool_layout_t layout;
+    pool_header_t* pools; // header array, at the start of the heap or in `headers` (see plan_layout())
+    int pool_shift;       // log2(pool_size) with POOL_LAYOUT_POW2, 0 if pool_size isn't a power of two
+    size_t pool_offsets[MAX_NUM_POOLS + 1]; // prefix offsets of every pool from base_addr, when pool_size is 0
+    bool fill_slack;                        // pool tails hold blocks of the smallest class (see fill_pool_slack())
+    size_t slack_offsets[MAX_NUM_POOLS];    // offset from base_addr where each pool's tail slack begins
+    size_t recovered_bytes;                 // slack bytes fill_pool_slack() turned into blocks
+    size_t trailing_used;                   // bytes handed out from the region behind end_addr
+    uint8_t* trailing_blocks;               // blocks of trailing_class carved from that region, from here on
+    int trailing_class;
+    bool initialized;
+    pool_header_t* last_used_pool;
+
+    // Span table with POOL_LAYOUT_SPANS (see carve_span()), NULL with every other layout
+    span_header_t* spans;
+    size_t num_spans;
+    size_t fresh_spans;       // spans taken from the never used end of the heap so far
+    int64_t empty_spans;      // carved spans without live blocks, telling reclaim_spans() when to bother
+    bool reclaiming;          // a thread is in reclaim_spans()
+    pool_header_t span_pool;  // free list of spans no pool is using, linked through their first bytes
+    pool_head_t span_head;
+
+    // Heap growth (see pool_allocator_set_growth()), the page map is NULL unless it's enabled
+    struct page_map* page_map; // span descriptors of every chunk, by address
+    pool_growth_t growth;
+    pool_chunk_t* chunks;      // newest first, only the newest may still have never used spans
+    size_t chunk_bytes;
+    size_t next_chunk_size;
+    pthread_mutex_t growth_lock;
+
+    // Size-class index (see build_size_class_table()). Class sizes are rounded up to their class's alignment.
+    size_t class_sizes[MAX_NUM_POOLS];
+    size_t alignments[MAX_NUM_POOLS]; // every block of class i is aligned to alignments[i]
+    size_t max_alignment;
+    uint8_t size_class_table[(SIZE_CLASS_TABLE_MAX >> SIZE_CLASS_SHIFT) + 1];
+    int large_class_start; // first class whose block size exceeds SIZE_CLASS_TABLE_MAX
+
+    // Thread caching front end (see pool_allocator_enable_thread_cache())
+    bool thread_cache;
+    pthread_key_t cache_key;
+    pthread_mutex_t lock; // guards the shared pools for the thread cache unless LOCK_FREE
+    size_t cache_capacity[MAX_NUM_POOLS];
+
+    // Allocation profile, NULL unless profiling is enabled
+    struct pool_profile_data* profile;
+    struct pool_trace_data* trace; // NULL unless tracing is enabled
+    uint64_t oversized; // allocations larger than every class, with POOL_STATS (the rest is in the pool heads)
+
+    // Classes whole blocks were split into, NULL unless splitting is enabled
+    struct pool_split_data* splits;
+
+    // Heap ownership (see pool_allocator_set_owner()). Blocks freed by other threads are pushed onto
+    // the remote-free queue, kept on its own cache line so foreign frees don't contend with the owner.
+    bool owned;
+    pthread_t owner;
+
+    // Bit i is set while pool i may have free blocks (see mark_pool_empty()), letting allocations
+    // skip exhausted pools with a single ctz. Kept off the owner's and remote frees' cache lines.
+    uint64_t free_pools __attribute__((aligned(CACHE_LINE_SIZE)));
+
+    // Pool headers kept out of the heap with POOL_LAYOUT_POW2, and the mutable heads of every layout
+    pool_header_t headers[MAX_NUM_POOLS] __attribute__((aligned(CACHE_LINE_SIZE)));
+    pool_head_t heads[MAX_NUM_POOLS];
+    block_header_t* remote_free __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+/**
+ * Per-thread, per-size-class magazines of free blocks. Cached blocks are chained
+ * through their block headers exactly like the shared free lists.
+ */
+struct pool_thread_cache
+{
+    pool_allocator_t* allocator;
+    struct
+    {
+        block_header_t* head;
+        size_t count;
+    } bins[MAX_NUM_POOLS];
+};
+
+static const int byte_align = sizeof(void*);
+
+// Size histogram buckets: one per 8 bytes up to PROFILE_GRANULE_MAX, then one per power of two
+#define PROFILE_GRANULE_BUCKETS ((PROFILE_GRANULE_MAX >> 3) + 1)
+#define PROFILE_BUCKETS (PROFILE_GRANULE_BUCKETS + 64)
+
+/**
+ * Opt-in allocation profile of one instance (see pool_allocator_enable_profiling()).
+ */
+struct pool_profile_data
+{
+    uint64_t histogram[PROFILE_BUCKETS];
+    uint64_t overflows[MAX_NUM_POOLS];
+    int64_t live[MAX_NUM_POOLS];
+    int64_t peak_live[MAX_NUM_POOLS];
+    uint64_t oversized;
+};
+
+/**
+ * Opt-in ring buffer of allocation events of one instance (see pool_allocator_enable_trace()).
+ */
+struct pool_trace_data
+{
+    pool_trace_event_t* events; // cache line aligned, so every event lies within one line
+    uint64_t mask;              // capacity - 1
+    uint64_t next;              // events recorded so far, the next one goes to events[next & mask]
+    uint64_t start_ticks;
+    struct timespec start_time;
+    char* failure_path; // NULL unless failed allocations dump the ring
+    uint64_t dumped_at; // value of `next` at the last dump on failure, 0 if none
+};
+
+/**
+ * Opt-in record of the blocks carved into smaller ones (see pool_allocator_enable_splitting()).
+ * One entry per block of every pool: the class it was split into plus one, or 0 while it's whole.
+ */
+struct pool_split_data
+{
+    size_t first_block[MAX_NUM_POOLS]; // entry of each pool's first block
+    uint8_t classes[];
+};
+
+// Free list heads pack an ABA tag above the block address (48-bit user space on 64-bit targets)
+#define TAG_SHIFT (sizeof(void*) == 8 ? 48 : 32)
+#define TAG_PTR_MASK ((UINT64_C(1) << TAG_SHIFT) - 1)
+
+/**
+ * Span region a growable instance obtained on top of its heap (see add_chunk()). The chunk starts
+ * with this descriptor, followed by the chunk's span table and its aligned spans.
+ */
+struct pool_chunk
+{
+    struct pool_chunk* next; // next older chunk
+    void* memory;            // the chunk as obtained, to give it back on destroy
+    size_t size;
+    span_header_t* spans;
+    byte_ptr_t base_addr;
+    size_t num_spans;
+    size_t fresh_spans;
+    size_t index; // chunks added before this one, plus one
+};
+
+// Page map levels: three of these many bits of a span's address cover the whole user address space
+#define PAGE_MAP_BITS ((TAG_SHIFT - SPAN_SHIFT + 2) / 3)
+#define PAGE_MAP_MASK ((UINT64_C(1) << PAGE_MAP_BITS) - 1)
+
+/**
+ * Radix tree from span addresses to the descriptors of chunk spans, and the chunks holding them.
+ * Nodes are only ever added (under the growth lock), so lookups walk it without locking.
+ */
+typedef struct page_map_leaf
+{
+    span_header_t* spans[1 << PAGE_MAP_BITS];
+    pool_chunk_t* chunks[1 << PAGE_MAP_BITS]; // so traces place a block in O(1)
+} page_map_leaf_t;
+
+typedef struct page_map_node
+{
+    page_map_leaf_t* leaves[1 << PAGE_MAP_BITS];
+} page_map_node_t;
+
+struct page_map
+{
+    page_map_node_t* nodes[1 << PAGE_MAP_BITS];
+};
+
+// ============= HELPER FUNCTION DECLARATIONS =============
+
+/**
+ * Point an allocator instance at its backing heap, mmap'ing one if `heap` is NULL.
+ */
+static bool attach_heap(pool_allocator_t* allocator, void* heap, size_t heap_size);
+
+/**
+ * Unmap the allocator's heap if it was mmap'd by attach_heap().
+ */
+static void release_heap(pool_allocator_t* allocator);
+
+/**
+ * Return a block known to belong to `pool` to the instance, through the remote-free queue
+ * (from a thread that doesn't own the instance), the thread cache, or straight to the pool.
+ */
+static void release_block(pool_allocator_t* allocator, pool_header_t* pool, void* ptr);
+
+/**
+ * Give a pool another span's worth of free blocks.
+ */
+static bool carve_span(pool_allocator_t* allocator, pool_header_t* pool);
+
+/**
+ * Take an unused span from the shared span pool, the never used ends of the heap and its newest chunk,
+ * the fully free spans of other pools, or a new chunk, in that order. Returns NULL if there's none.
+ */
+static byte_ptr_t take_span(pool_allocator_t* allocator);
+
+/**
+ * Claim the next never used span of a span region, NULL once they have all been handed out.
+ */
+static byte_ptr_t claim_fresh_span(size_t* fresh_spans, byte_ptr_t base, size_t num_spans);
+
+/**
+ * Return fully free spans to the shared span pool. Only one thread reclaims at a time,
+ * any other caller returns 0 right away.
+ */
+static size_t reclaim_spans(pool_allocator_t* allocator);
+
+/**
+ * Reset the reclaim counts of a span region and return the mask of pools with spans there
+ * that have no live blocks.
+ */
+static uint64_t find_span_donors(span_header_t* spans, size_t num_spans);
+
+/**
+ * Hand every fully free span of a span region over to the span pool. Returns the number released.
+ */
+static size_t release_free_spans(pool_allocator_t* allocator, span_header_t* spans, byte_ptr_t base,
+                                 size_t num_spans);
+
+/**
+ * Count blocks leaving (delta > 0) or going back onto (delta < 0) their pools' free lists
+ * against their spans. Blocks must be counted after they leave a free list and before they go back.
+ */
+static void count_span_block(pool_allocator_t* allocator, void* ptr, int32_t delta);
+static void count_span_chain(pool_allocator_t* allocator, block_header_t* first, block_header_t* last,
+                             int32_t delta);
+
+/**
+ * Whether every block of a span was found free by reclaim_spans().
+ */
+static bool span_is_free(pool_allocator_t* allocator, span_header_t* span);
+
+/**
+ * Descriptor of the span holding ptr, NULL if ptr is outside the heap and its chunks.
+ */
+static span_header_t* get_span(pool_allocator_t* allocator, void* ptr);
+
+/**
+ * Look up the descriptor of a span of one of the instance's chunks in its page map.
+ * Returns NULL if ptr isn't in any chunk's spans (or growth isn't enabled).
+ */
+static span_header_t* find_chunk_span(pool_allocator_t* allocator, void* ptr);
+
+/**
+ * Look up the chunk holding ptr in the instance's page map, NULL if there's none.
+ */
+static pool_chunk_t* find_chunk(pool_allocator_t* allocator, void* ptr);
+
+/**
+ * Page map leaf covering ptr's span, NULL if growth isn't enabled or no chunk was ever mapped around it.
+ */
+static page_map_leaf_t* find_page_map_leaf(pool_allocator_t* allocator, void* ptr);
+
+/**
+ * Whether ptr lies within the blocks of the heap or of one of its chunks.
+ */
+static bool heap_contains(pool_allocator_t* allocator, void* ptr);
+
+/**
+ * Obtain another chunk for a growable instance, cut it into spans and enter them into the page map.
+ * Returns false once growth isn't enabled, a limit is hit or no memory can be had.
+ */
+static bool grow_heap(pool_allocator_t* allocator);
+static bool add_chunk(pool_allocator_t* allocator);
+
+/**
+ * Give every chunk back and free the page map on destroy.
+ */
+static void release_chunks(pool_allocator_t* allocator);
+
+/**
+ * Give a span pool more free blocks by carving it a new span. Other layouts bump their frontier instead.
+ * grow_fitting_pool() carves a span for the pool best fitting n bytes, so it can serve n instead of spilling.
+ */
+static bool grow_pool(pool_allocator_t* allocator, pool_header_t* pool);
+static bool grow_fitting_pool(pool_allocator_t* allocator, size_t n);
+
+/**
+ * Carve a free block of `pool` into blocks of the class fitting n and push them onto that class's free list.
+ * Returns false if splitting isn't enabled, the block wouldn't make at least two, or the pool has none to split.
+ */
+static bool split_block(pool_allocator_t* allocator, pool_header_t* pool, size_t n);
+
+/**
+ * Pool a block found in `pool` by address really belongs to, i.e. the class it was split into if it was.
+ */
+static pool_header_t* find_split_pool(pool_allocator_t* allocator, pool_header_t* pool, void* ptr);
+
+/**
+ * Record an allocation of n bytes from `pool` (NULL if it failed) or the free of a block from `pool`
+ * in the instance's profile.
+ */
+static void profile_alloc(pool_allocator_t* allocator, pool_header_t* pool, size_t n);
+static void profile_free(pool_allocator_t* allocator, pool_header_t* pool);
+
+/**
+ * Snapshot an instance's size histogram and sum it up into requests per size class.
+ */
+static void profile_requests(pool_allocator_t* allocator, uint64_t* histogram, uint64_t* class_requests);
+
+/**
+ * Bump a profile counter. Cheap, but concurrent increments may be lost.
+ */
+static void profile_count(uint64_t* counter);
+
+/**
+ * Record `count` blocks leaving a pool (raising its peak if need be), add to one of its statistics counters,
+ * or record `count` failed allocations against a class (-1 for requests larger than every class).
+ */
+static void stats_alloc(pool_header_t* pool, size_t count);
+static void stats_count(uint64_t* counter, size_t count);
+static void stats_failure(pool_allocator_t* allocator, int class_index, size_t count);
+
+/**
+ * Whether allocations and frees need to be passed on to the profile or the trace, and doing so.
+ */
+static bool recording(pool_allocator_t* allocator);
+static void record_alloc(pool_allocator_t* allocator, pool_header_t* pool, size_t n, void* ptr);
+static void record_free(pool_allocator_t* allocator, pool_header_t* pool, void* ptr);
+
+/**
+ * Trace an allocation of n bytes from `pool` (ptr is NULL if it failed), or store any event in the instance's ring.
+ */
+static void trace_alloc(pool_allocator_t* allocator, pool_header_t* pool, size_t n, void* ptr);
+static void trace_event(pool_allocator_t* allocator, uint8_t op, size_t n, int pool_index, void* ptr);
+
+/**
+ * Dump the ring to the instance's failure path, unless it was dumped there with mostly the same events before.
+ */
+static void dump_trace_on_failure(pool_allocator_t* allocator);
+
+/**
+ * Trace timestamps: the time stamp counter where there is one, nanoseconds otherwise,
+ * and their rate calibrated against the monotonic clock.
+ */
+static uint64_t trace_ticks(void);
+static uint64_t trace_ticks_per_second(pool_allocator_t* allocator);
+
+/**
+ * Free the instance's trace ring, if any, on destroy.
+ */
+static void release_trace(pool_allocator_t* allocator);
+
+/**
+ * Histogram bucket of a request size, and the largest request size falling into a bucket.
+ */
+static size_t profile_bucket(size_t n);
+static size_t profile_bucket_size(size_t bucket);
+
+/**
+ * Allocate n bytes directly from the shared pools (no thread cache), setting `from` to the pool the block
+ * came from. Sets `fresh` (unless NULL) if the block was bumped off its pool's frontier, i.e. was never written.
+ */
+static void* shared_alloc(pool_allocator_t* allocator, size_t n, pool_header_t** from, bool* fresh);
+
+/**
+ * Allocate up to `count` blocks of n bytes directly from the shared pools (no thread cache), recording
+ * each batch along with the pool it came from. Returns the number of blocks allocated.
+ */
+static size_t shared_alloc_bulk(pool_allocator_t* allocator, size_t n, size_t count, void** out_ptrs);
+
+/**
+ * Pop up to `count` free blocks off a pool into `out_ptrs`, detaching them from the free list in one go
+ * and claiming any shortfall from the pool's uninitialized blocks. Returns the number of blocks popped.
+ */
+static size_t pop_free_blocks(pool_allocator_t* allocator, pool_header_t* pool, size_t count, void** out_ptrs);
+
+/**
+ * Pop the first free block off a pool, bumping the pool's frontier (or carving a span) if the free list is empty.
+ * Sets `fresh` (unless NULL) if the block came off the frontier. Returns NULL if the pool has no free blocks left.
+ */
+static block_header_t* pop_free_block(pool_allocator_t* allocator, pool_header_t* pool, bool* fresh);
+
+/**
+ * Push a freed block onto its pool's free list.
+ */
+static void push_free_block(pool_allocator_t* allocator, pool_header_t* pool, void* ptr);
+
+/**
+ * Push a chain of `count` freed blocks first..last onto their pool's free list, flagging the pool as non-empty.
+ */
+static void push_free_chain(pool_allocator_t* allocator, pool_header_t* pool, block_header_t* first,
+                            block_header_t* last, size_t count);
+
+/**
+ * Chain a freed block onto the per-pool group it belongs to (skipped if `pool` is NULL),
+ * and splice every group onto its pool's free list once all blocks are grouped.
+ */
+static void group_free_block(pool_allocator_t* allocator, pool_header_t* pool, block_header_t* bptr,
+                             block_header_t** firsts, block_header_t** lasts, size_t* counts);
+static void push_free_groups(pool_allocator_t* allocator, block_header_t** firsts, block_header_t** lasts,
+                             size_t* counts);
+
+/**
+ * Set or clear a pool's bit in the free pool mask.
+ *
+ * Clearing re-checks the pool afterwards and sets the bit again if a concurrent free slipped in,
+ * so a bit may be stale while set (corrected by the next failed pop) but never while clear.
+ */
+static void mark_pool_free(pool_allocator_t* allocator, pool_header_t* pool);
+static void mark_pool_empty(pool_allocator_t* allocator, pool_header_t* pool);
+
+/**
+ * Whether the pool has any free or not-yet-initialized blocks left (racy hint under concurrency).
+ */
+static bool pool_has_free(pool_header_t* pool);
+
+/**
+ * Gets the (untagged) first free block of a pool.
+ */
+static block_header_t* free_list_head(pool_header_t* pool);
+
+/**
+ * Pops the first free block off a pool's free list (lock-free with LOCK_FREE).
+ */
+static block_header_t* free_list_pop(pool_header_t* pool);
+
+/**
+ * Detaches up to `max` blocks off the front of a pool's free list with a single head update (lock-free
+ * with LOCK_FREE). Returns the first block and sets `count` to the length of the detached chain.
+ */
+static block_header_t* free_list_pop_chain(pool_allocator_t* allocator, pool_header_t* pool, size_t max,
+                                           size_t* count);
+
+/**
+ * Detaches a pool's whole free list with a single head update (lock-free with LOCK_FREE), without reading
+ * any of its blocks. Returns the first block, or NULL if the list was empty.
+ */
+static block_header_t* free_list_detach(pool_header_t* pool);
+
+/**
+ * Splices the chain first..last onto a pool's free list with a single head update (lock-free with LOCK_FREE).
+ *
+ * Returns true if the free list was empty before the push.
+ */
+static bool free_list_push(pool_header_t* pool, block_header_t* first, block_header_t* last);
+
+/**
+ * Serializes access to the shared pools when they aren't lock-free.
+ */
+static void shared_lock(pool_allocator_t* allocator);
+static void shared_unlock(pool_allocator_t* allocator);
+
+/**
+ * Allocate n bytes through the calling thread's cache, refilling it from the shared pools on a miss.
+ * Sets `pool` to the pool the block came from.
+ */
+static void* thread_cache_alloc(pool_allocator_t* allocator, size_t n, pool_header_t** pool);
+
+/**
+ * Pop a block of the given class off the calling thread's cache, refilling it on a miss.
+ * Returns NULL if the class is exhausted (or uncached), without spilling.
+ */
+static void* thread_cache_pop(pool_allocator_t* allocator, int class_index);
+
+/**
+ * Free a block into the calling thread's cache, flushing half of it if it overflows.
+ */
+static void thread_cache_free(pool_allocator_t* allocator, pool_header_t* pool, void* ptr);
+
+/**
+ * Gets (creating it on first use) the calling thread's cache for this instance.
+ */
+static pool_thread_cache_t* get_thread_cache(pool_allocator_t* allocator);
+
+/**
+ * Moves a batch of free blocks from the shared pool into the thread's magazine for that class.
+ * Returns false if the shared pool had nothing to give.
+ */
+static bool refill_thread_cache(pool_allocator_t* allocator, pool_thread_cache_t* cache, int class_index);
+
+/**
+ * Returns all but `keep` blocks of the thread's magazine for that class to the shared pool.
+ */
+static void flush_thread_cache(pool_allocator_t* allocator, pool_thread_cache_t* cache, int class_index, size_t keep);
+
+/**
+ * Thread exit destructor, flushing and releasing a thread's cache.
+ */
+static void destroy_thread_cache(void* ptr);
+
+/**
+ * Queue a block (or a chain of blocks first..last) freed by a thread other than the owner on the remote-free queue.
+ */
+static void push_remote_free(pool_allocator_t* allocator, void* ptr);
+static void push_remote_chain(pool_allocator_t* allocator, block_header_t* first, block_header_t* last);
+
+/**
+ * Detach the whole remote-free queue and splice its blocks onto their pools, one splice per pool.
+ * Returns the number of blocks reclaimed. Callers hold the shared lock.
+ */
+static size_t drain_remote_frees(pool_allocator_t* allocator);
+
+/**
+ * Drain the remote-free queue if the calling thread owns the instance and the queue isn't empty.
+ * Returns true if any blocks were reclaimed.
+ */
+static bool drain_on_miss(pool_allocator_t* allocator);
+static bool locked_drain_on_miss(pool_allocator_t* allocator);
+
+/**
+ * Gets the pool header corresponding to the ith block size.
+ */
+static pool_header_t* get_pool(pool_allocator_t* allocator, int i);
+
+/**
+ * Gets the block size index corresponding to the pool header.
+ */
+static int get_pool_index(pool_allocator_t* allocator, pool_header_t* pool);
+
+/**
+ * Places the pool headers and pools within the heap according to the requested layout.
+ * Returns false if the heap can't fit every pool.
+ */
+static bool plan_layout(pool_allocator_t* allocator, const pool_config_t* config);
+
+/**
+ * Sizes each pool according to the configured capacities, filling in the prefix-offset table.
+ * Returns false if the pools don't fit in `available` bytes.
+ */
+static bool plan_capacities(pool_allocator_t* allocator, const pool_config_t* config, size_t available);
+
+/**
+ * Places the span table and as many aligned spans as fit within the heap, all of them unused.
+ * Returns false if the heap can't fit a single span.
+ */
+static bool plan_spans(pool_allocator_t* allocator);
+
+/**
+ * Places a table of unused span descriptors at the start of `size` bytes and as many aligned spans
+ * as still fit behind it. Returns the number of spans, 0 if not even one fits.
+ */
+static size_t plan_span_table(byte_ptr_t start, size_t size, span_header_t** table, byte_ptr_t* base);
+
+/**
+ * Cut the tail slack of every pool into blocks of the smallest class and push them onto its free list.
+ */
+static void fill_pool_slack(pool_allocator_t* allocator);
+
+/**
+ * `offset / divisor`, multiplying by `reciprocal` (see plan_reciprocal()) instead when it's non-zero.
+ */
+static inline size_t divide_offset(size_t offset, size_t divisor, uint64_t reciprocal);
+
+/**
+ * ceil(2^64 / divisor), which divide_offset() may use for every offset within the heap, or 0 if it can't.
+ */
+static uint64_t plan_reciprocal(pool_allocator_t* allocator, size_t divisor);
+
+/**
+ * Bytes between the end of the last pool and the end of the heap.
+ */
+static inline size_t trailing_size(pool_allocator_t* allocator);
+
+/**
+ * Byte offsets of the `i`th pool's start and end relative to the base address.
+ */
+static size_t pool_start_offset(pool_allocator_t* allocator, int i);
+static size_t pool_end_offset(pool_allocator_t* allocator, int i);
+
+/**
+ * Create a pool header for the ith block size and point it to the pool's first free block.
+ */
+static pool_header_t* create_pool_header(pool_allocator_t* allocator, size_t block_size, int i);
+
+/**
+ * Claims a run of up to `max` uninitialized blocks at the pool's frontier with a CAS on `num_initialized`,
+ * pointing `first` at the first of them. Returns the number of blocks claimed (0 once the pool is fully initialized).
+ *
+ * With lazy init, blocks past the frontier are never written before they're first handed out: allocation pops
+ * the free list if it's non-empty and otherwise bumps the frontier by one, so only freed blocks ever get a header.
+ * This keeps initialization O(N) rather than O(N + M) (N = number of pools, M = total number of blocks).
+ */
+static size_t claim_fresh_blocks(pool_header_t* pool, size_t max, byte_ptr_t* first);
+
+/**
+ * Generates a complete free list by populating every block inthe given pool with a block header.
+ * 
+ * Runs in linear time w.r.t. the number of blocks in a given pool.
+ */
+static void populate_block_headers(pool_header_t* pool);
+
+/**
+ * Finds the smallest pool fitting n bytes that still has free space, spilling into larger pools as needed.
+ * 
+ * With SIZE_CLASS_TABLE the fitting pool comes from find_size_class() in O(1) for small sizes, otherwise
+ * from the last used pool cache or a binary search through the pool headers (O(log(N)) for N pools).
+ */
+static pool_header_t* find_pool_from_size(pool_allocator_t* allocator, size_t n);
+
+/**
+ * Remember the pool an allocation came from for the next lookup, when the POOL_CACHE lookup is in use.
+ */
+static void remember_pool(pool_allocator_t* allocator, pool_header_t* pool);
+
+/**
+ * Finds the index of the smallest block size that fits n bytes, ignoring free space.
+ *
+ * With SIZE_CLASS_TABLE, sizes up to SIZE_CLASS_TABLE_MAX take one load from the dense size-class table
+ * plus a short forward scan within the granule, and larger sizes a branchless count over the classes
+ * above the cutoff. Otherwise a binary search through the pool headers.
+ *
+ * Returns -1 if n is larger than every block size.
+ */
+static int find_size_class(pool_allocator_t* allocator, size_t n);
+
+/**
+ * Builds the dense size-class table mapping each SIZE_CLASS_SHIFT-byte granule of request sizes
+ * up to SIZE_CLASS_TABLE_MAX to the smallest class that can fit its smallest size.
+ * 
+ * Runs once per pool_init() in O(SIZE_CLASS_TABLE_MAX >> SIZE_CLASS_SHIFT + N) for N pools.
+ */
+static void build_size_class_table(pool_allocator_t* allocator);
+
+/**
+ * Binary search through the prefix-offset table for the pool containing the given byte offset.
+ *
+ * Runs in O(log(N)) for N pools, only needed when pools differ in size.
+ */
+static int find_pool_from_offset(pool_allocator_t* allocator, size_t offset);
+
+/**
+ * Whether ptr lies within the `i`th pool, using comparisons only.
+ */
+static bool pool_contains(pool_allocator_t* allocator, int i, void* ptr);
+
+/**
+ * Finds the pool header corresponding to the pointer in memory.
+ * 
+ * Returns NULL if an invalid pointer.
+ */
+static pool_header_t* find_pool_from_pointer(pool_allocator_t* allocator, void* ptr);
+
+static uint8_t g_pool_heap[HEAP_SIZE_BYTES];
+
+// Default instance backing the global pool_init()/pool_alloc()/pool_free() API
+static pool_allocator_t g_default_allocator = {
+    .heap = g_pool_heap,
+    .heap_size = HEAP_SIZE_BYTES,
+    .zeroed_heap = true,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .growth_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// ============ TUNABLE BLOCK POOL ALLOCATOR ===============
+
+bool pool_init(const size_t* block_sizes, size_t block_size_count)
+{
+    return pool_allocator_init(&g_default_allocator, block_sizes, block_size_count);
+}
+
+bool pool_init_ex(const pool_config_t* config)
+{
+    return pool_allocator_init_ex(&g_default_allocator, config);
+}
+
+bool pool_init_heap(void* heap, size_t heap_size, const size_t* block_sizes, size_t block_size_count)
+{
+    pool_allocator_t* allocator = &g_default_allocator;
+    bool zeroed_heap = allocator->zeroed_heap;
+    if (allocator->initialized || !attach_heap(allocator, heap, heap_size))
+    {
+        return false;
+    }
+
+    if (!pool_allocator_init(allocator, block_sizes, block_size_count))
+    {
+        // Fall back to the static heap so a later pool_init() still works
+        release_heap(allocator);
+        attach_heap(allocator, g_pool_heap, HEAP_SIZE_BYTES);
+        allocator->zeroed_heap = zeroed_heap;
+        return false;
+    }
+
+    return true;
+}
+
+void* pool_alloc(size_t n)
+{
+    return pool_allocator_alloc(&g_default_allocator, n);
+}
+
+void pool_free(void* ptr)
+{
+    pool_allocator_free(&g_default_allocator, ptr);
+}
+
+int pool_size_class(size_t n)
+{
+    return pool_allocator_size_class(&g_default_allocator, n);
+}
+
+void* pool_alloc_class(int class_id)
+{
+    return pool_allocator_alloc_class(&g_default_allocator, class_id);
+}
+
+void* pool_alloc_aligned(size_t n, size_t alignment)
+{
+    return pool_allocator_alloc_aligned(&g_default_allocator, n, alignment);
+}
+
+void pool_free_sized(void* ptr, size_t n)
+{
+    pool_allocator_free_sized(&g_default_allocator, ptr, n);
+}
+
+void pool_free_class(void* ptr, int class_id)
+{
+    pool_allocator_free_class(&g_default_allocator, ptr, class_id);
+}
+
+size_t pool_alloc_bulk(size_t n, size_t count, void** out_ptrs)
+{
+    return pool_allocator_alloc_bulk(&g_default_allocator, n, count, out_ptrs);
+}
+
+void pool_free_bulk(void** ptrs, size_t count)
+{
+    pool_allocator_free_bulk(&g_default_allocator, ptrs, count);
+}
+
+void* pool_realloc(void* ptr, size_t n)
+{
+    return pool_allocator_realloc(&g_default_allocator, ptr, n);
+}
+
+size_t pool_usable_size(void* ptr)
+{
+    return pool_allocator_usable_size(&g_default_allocator, ptr);
+}
+
+void* pool_calloc(size_t count, size_t size)
+{
+    return pool_allocator_calloc(&g_default_allocator, count, size);
+}
+
+// ============ ALLOCATOR INSTANCES ===============
+
+pool_allocator_t* pool_allocator_create(void)
+{
+    return pool_allocator_create_heap(NULL, HEAP_SIZE_BYTES);
+}
+
+pool_allocator_t* pool_allocator_create_heap(void* heap, size_t heap_size)
+{
+    // The remote-free queue needs the instance to be cache line aligned
+    pool_allocator_t* allocator;
+    if (posix_memalign((void**)&allocator, CACHE_LINE_SIZE, sizeof(pool_allocator_t)) != 0)
+    {
+        return NULL;
+    }
+
+    memset(allocator, 0, sizeof(pool_allocator_t));
+
+    if (!attach_heap(allocator, heap, heap_size))
+    {
+        free(allocator);
+        return NULL;
+    }
+
+    pthread_mutex_init(&allocator->lock, NULL);
+    pthread_mutex_init(&allocator->growth_lock, NULL);
+
+    return allocator;
+}
+
+bool pool_allocator_init(pool_allocator_t* allocator, const size_t* block_sizes, size_t block_size_count)
+{
+    pool_config_t config = {
+        .block_sizes = block_sizes,
+        .block_size_count = block_size_count,
+        .layout = POOL_LAYOUT_EVEN,
+        .capacity = POOL_CAPACITY_EVEN,
+    };
+
+    return pool_allocator_init_ex(allocator, &config);
+}
+
+bool pool_allocator_init_ex(pool_allocator_t* allocator, const pool_config_t* config)
+{
+    // Make sure we have a valid number of block sizes
+    if (allocator == NULL || allocator->initialized || config == NULL || config->block_sizes == NULL ||
+        config->block_size_count <= 0 || config->block_size_count > MAX_NUM_POOLS)
+    {
+        return false;
+    }
+
+    // A failed init may leave pool headers behind, so the heap only counts as zeroed again once init succeeds
+    bool zeroed_heap = allocator->zeroed_heap;
+    allocator->zeroed_heap = false;
+
+    // Initialize instance state
+    allocator->num_pools = (int)config->block_size_count;
+    if (!plan_layout(allocator, config))
+    {
+        return false;
+    }
+
+    // Populate the heap with pool headers and pools of free blocks
+    size_t last_block_size = 0;
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        size_t block_size = allocator->class_sizes[i];
+        if (block_size <= last_block_size || block_size == 0)
+        {
+            return false;
+        }
+
+        // Create a pool header for this block size
+        // and point it to the pool's first free block
+        pool_header_t* pool = create_pool_header(allocator, block_size, i);
+        if (pool == NULL)
+        {
+            return false;
+        }
+
+        if (!LAZY_INIT && allocator->spans == NULL)
+        {
+            // Populate every free block in the pool with a block header
+            // (which get overwritten on allocation)
+            populate_block_headers(pool);
+        }
+
+        last_block_size = block_size;
+    }
+
+    if (allocator->fill_slack)
+    {
+        fill_pool_slack(allocator);
+    }
+
+    build_size_class_table(allocator);
+    allocator->free_pools = allocator->num_pools == 64 ? UINT64_MAX : (UINT64_C(1) << allocator->num_pools) - 1;
+    allocator->last_used_pool = get_pool(allocator, 0);
+    allocator->zeroed_heap = zeroed_heap;
+    allocator->initialized = true;
+
+    return true;
+}
+
+void* pool_allocator_alloc(pool_allocator_t* allocator, size_t n)
+{
+    if (allocator == NULL || !allocator->initialized || n == 0)
+    {
+        return NULL;
+    }
+
+    pool_header_t* pool;
+    void* ptr = allocator->thread_cache ? thread_cache_alloc(allocator, n, &pool)
+                                        : shared_alloc(allocator, n, &pool, NULL);
+    if (recording(allocator))
+    {
+        record_alloc(allocator, pool, n, ptr);
+    }
+
+    return ptr;
+}
+
+void pool_allocator_free(pool_allocator_t* allocator, void* ptr)
+{
+    if (allocator == NULL || !allocator->initialized)
+    {
+        return;
+    }
+
+    pool_header_t* pool = find_pool_from_pointer(allocator, ptr);
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    release_block(allocator, pool, ptr);
+}
+
+void pool_allocator_destroy(pool_allocator_t* allocator)
+{
+    // The default instance is statically allocated and lives for the whole process
+    if (allocator == NULL || allocator == &g_default_allocator)
+    {
+        return;
+    }
+
+    if (allocator->thread_cache)
+    {
+        // Cached blocks die with the heap, so the calling thread's cache is simply dropped.
+        // Other threads must have flushed their caches (or exited) beforehand.
+        free(pthread_getspecific(allocator->cache_key));
+        pthread_key_delete(allocator->cache_key);
+    }
+
+    free(allocator->profile);
+    release_trace(allocator);
+    free(allocator->splits);
+    release_chunks(allocator);
+    pthread_mutex_destroy(&allocator->lock);
+    pthread_mutex_destroy(&allocator->growth_lock);
+    release_heap(allocator);
+    free(allocator);
+}
+
+bool pool_allocator_layout_info(pool_allocator_t* allocator, pool_layout_info_t* info)
+{
+    if (allocator == NULL || !allocator->initialized || info == NULL)
+    {
+        return false;
+    }
+
+    info->layout = allocator->layout;
+    info->trailing_bytes = 0;
+    info->chunk_count = 0;
+    pthread_mutex_lock(&allocator->growth_lock);
+    for (pool_chunk_t* chunk = allocator->chunks; chunk != NULL; chunk = chunk->next)
+    {
+        info->chunk_count++;
+    }
+    info->chunk_bytes = allocator->chunk_bytes;
+    pthread_mutex_unlock(&allocator->growth_lock);
+
+    if (allocator->spans != NULL)
+    {
+        // Spans change hands, so slack is whatever the currently carved spans can't fit
+        info->pool_span = SPAN_SIZE_BYTES;
+        info->header_bytes = allocator->num_spans * sizeof(span_header_t);
+        info->slack_bytes = 0;
+        info->recovered_bytes = 0;
+        for (size_t i = 0; i < allocator->num_spans; i++)
+        {
+            int class_index = __atomic_load_n(&allocator->spans[i].class_index, __ATOMIC_RELAXED);
+            if (class_index >= 0)
+            {
+                info->slack_bytes += SPAN_SIZE_BYTES % get_pool(allocator, class_index)->stride;
+            }
+        }
+
+        info->padding_bytes = allocator->heap_size - info->header_bytes - allocator->num_spans * SPAN_SIZE_BYTES;
+        return true;
+    }
+
+    info->pool_span = allocator->pool_size;
+    info->header_bytes = allocator->layout != POOL_LAYOUT_POW2 ? allocator->num_pools * sizeof(pool_header_t) : 0;
+    info->slack_bytes = 0;
+    info->recovered_bytes = 0;
+    info->trailing_bytes = trailing_size(allocator) - __atomic_load_n(&allocator->trailing_used, __ATOMIC_RELAXED);
+
+    size_t pool_bytes = 0;
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        pool_header_t* pool = get_pool(allocator, i);
+        size_t bytes = pool_end_offset(allocator, i) - pool_start_offset(allocator, i);
+        pool_bytes += bytes;
+        info->slack_bytes += bytes - pool->num_blocks * pool->stride;
+    }
+
+    // Whatever of the tails fit blocks of the smallest class was put to use
+    info->recovered_bytes = allocator->fill_slack ? allocator->recovered_bytes : 0;
+    info->slack_bytes -= info->recovered_bytes;
+
+    info->padding_bytes = allocator->heap_size - info->header_bytes - pool_bytes;
+
+    return true;
+}
+
+pool_allocator_t* pool_default_allocator(void)
+{
+    return &g_default_allocator;
+}
+
+// ============ SIZED FREES ===============
+
+int pool_allocator_size_class(pool_allocator_t* allocator, size_t n)
+{
+    if (allocator == NULL || !allocator->initialized || n == 0)
+    {
+        return -1;
+    }
+
+    return find_size_class(allocator, n);
+}
+
+void* pool_allocator_alloc_class(pool_allocator_t* allocator, int class_id)
+{
+    if (allocator == NULL || !allocator->initialized || class_id < 0 || class_id >= allocator->num_pools)
+    {
+        return NULL;
+    }
+
+    // Never spills, so the block can always be freed back by class
+    pool_header_t* pool = get_pool(allocator, class_id);
+    void* ptr;
+    if (allocator->thread_cache)
+    {
+        ptr = thread_cache_pop(allocator, class_id);
+    }
+    else
+    {
+        ptr = pop_free_block(allocator, pool, NULL);
+        if (ptr == NULL && drain_on_miss(allocator))
+        {
+            ptr = pop_free_block(allocator, pool, NULL);
+        }
+    }
+
+    if (POOL_STATS && ptr == NULL)
+    {
+        stats_failure(allocator, class_id, 1);
+    }
+
+    if (recording(allocator))
+    {
+        record_alloc(allocator, ptr == NULL ? NULL : pool, pool->block_size, ptr);
+    }
+
+    return ptr;
+}
+
+void pool_allocator_free_sized(pool_allocator_t* allocator, void* ptr, size_t n)
+{
+    if (allocator == NULL || !allocator->initialized || ptr == NULL)
+    {
+        return;
+    }
+
+    // The block usually sits in the pool fitting n, which a range check confirms without dividing.
+    // Otherwise it spilled into a larger pool when it was allocated, so look it up the slow way.
+    int class_id = find_size_class(allocator, n);
+    pool_header_t* pool = class_id < 0 ? NULL : get_pool(allocator, class_id);
+    if (pool == NULL || !pool_contains(allocator, class_id, ptr))
+    {
+        pool = find_pool_from_pointer(allocator, ptr);
+        if (pool == NULL)
+        {
+            return;
+        }
+    }
+
+    release_block(allocator, pool, ptr);
+}
+
+void pool_allocator_free_class(pool_allocator_t* allocator, void* ptr, int class_id)
+{
+    if (allocator == NULL || !allocator->initialized || ptr == NULL)
+    {
+        return;
+    }
+
+    assert(class_id >= 0 && class_id < allocator->num_pools && pool_contains(allocator, class_id, ptr));
+    release_block(allocator, get_pool(allocator, class_id), ptr);
+}
+
+void* pool_allocator_alloc_aligned(pool_allocator_t* allocator, size_t n, size_t alignment)
+{
+    if (allocator == NULL || !allocator->initialized || n == 0 || alignment == 0 || (alignment & (alignment - 1)))
+    {
+        return NULL;
+    }
+
+    if (alignment <= (size_t)byte_align)
+    {
+        return pool_allocator_alloc(allocator, n);
+    }
+
+    // Classes are sorted by size, so the first aligned class with a free block is the tightest fit
+    int class_index = alignment <= allocator->max_alignment ? find_size_class(allocator, n) : -1;
+    for (int i = class_index; i >= 0 && i < allocator->num_pools; i++)
+    {
+        if (allocator->alignments[i] >= alignment)
+        {
+            void* ptr = pool_allocator_alloc_class(allocator, i);
+            if (ptr != NULL)
+            {
+                return ptr;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// ============ REALLOCATION ===============
+
+void* pool_allocator_realloc(pool_allocator_t* allocator, void* ptr, size_t n)
+{
+    if (ptr == NULL)
+    {
+        return pool_allocator_alloc(allocator, n);
+    }
+
+    if (allocator == NULL || !allocator->initialized)
+    {
+        return NULL;
+    }
+
+    if (n == 0)
+    {
+        pool_allocator_free(allocator, ptr);
+        return NULL;
+    }
+
+    pool_header_t* pool = find_pool_from_pointer(allocator, ptr);
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    // The block already held fits n (be it its own class or one it spilled into), so nothing moves
+    if (n <= pool->block_size)
+    {
+        return ptr;
+    }
+
+    // Otherwise move to the class fitting n with a single copy, leaving the block untouched on failure
+    void* new_ptr = pool_allocator_alloc(allocator, n);
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(new_ptr, ptr, pool->block_size);
+    release_block(allocator, pool, ptr);
+
+    return new_ptr;
+}
+
+size_t pool_allocator_usable_size(pool_allocator_t* allocator, void* ptr)
+{
+    if (allocator == NULL || !allocator->initialized || ptr == NULL)
+    {
+        return 0;
+    }
+
+    pool_header_t* pool = find_pool_from_pointer(allocator, ptr);
+    return pool == NULL ? 0 : pool->block_size;
+}
+
+void* pool_allocator_calloc(pool_allocator_t* allocator, size_t count, size_t size)
+{
+    size_t n;
+    if (allocator == NULL || !allocator->initialized || __builtin_mul_overflow(count, size, &n) || n == 0)
+    {
+        return NULL;
+    }
+
+    // Blocks bumped off a pool's frontier have never been written, so on a zeroed heap they need no clearing.
+    // Blocks out of the free lists or a thread cache may hold anything.
+    bool fresh = false;
+    pool_header_t* pool;
+    void* ptr = allocator->thread_cache ? thread_cache_alloc(allocator, n, &pool)
+                                        : shared_alloc(allocator, n, &pool, &fresh);
+    if (recording(allocator))
+    {
+        record_alloc(allocator, pool, n, ptr);
+    }
+
+    if (ptr != NULL && !(fresh && allocator->zeroed_heap))
+    {
+        memset(ptr, 0, n);
+    }
+
+    return ptr;
+}
+
+// ============ BULK OPERATIONS ===============
+
+size_t pool_allocator_alloc_bulk(pool_allocator_t* allocator, size_t n, size_t count, void** out_ptrs)
+{
+    if (allocator == NULL || !allocator->initialized || n == 0 || out_ptrs == NULL)
+    {
+        return 0;
+    }
+
+    size_t allocated = 0;
+    if (allocator->thread_cache)
+    {
+        // Drain the calling thread's magazine first, then go to the shared pools for the rest
+        int class_index = find_size_class(allocator, n);
+        pool_thread_cache_t* cache = get_thread_cache(allocator);
+        if (class_index < 0)
+        {
+            if (POOL_STATS)
+            {
+                stats_failure(allocator, class_index, count);
+            }
+            for (size_t i = 0; recording(allocator) && i < count; i++)
+            {
+                record_alloc(allocator, NULL, n, NULL);
+            }
+            return 0;
+        }
+
+        while (cache != NULL && allocated < count && cache->bins[class_index].head != NULL)
+        {
+            block_header_t* free_block = cache->bins[class_index].head;
+            cache->bins[class_index].head = free_block->next;
+            cache->bins[class_index].count -= 1;
+            out_ptrs[allocated++] = free_block;
+        }
+
+        for (size_t i = 0; recording(allocator) && i < allocated; i++)
+        {
+            record_alloc(allocator, get_pool(allocator, class_index), n, out_ptrs[i]);
+        }
+
+        if (allocated == count)
+        {
+            return allocated;
+        }
+    }
+
+    shared_lock(allocator);
+    allocated += shared_alloc_bulk(allocator, n, count - allocated, out_ptrs + allocated);
+    shared_unlock(allocator);
+
+    // Failures are recorded out here, where dumping the trace on them holds no lock
+    for (size_t i = allocated; recording(allocator) && i < count; i++)
+    {
+        record_alloc(allocator, NULL, n, NULL);
+    }
+
+    return allocated;
+}
+
+void pool_allocator_free_bulk(pool_allocator_t* allocator, void** ptrs, size_t count)
+{
+    if (allocator == NULL || !allocator->initialized || ptrs == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; recording(allocator) && i < count; i++)
+    {
+        record_free(allocator, find_pool_from_pointer(allocator, ptrs[i]), ptrs[i]);
+    }
+
+    if (allocator->owned && !pthread_equal(pthread_self(), allocator->owner))
+    {
+        // Hand the whole batch to the owner with a single push onto its remote-free queue
+        block_header_t* first = NULL;
+        block_header_t* last = NULL;
+        for (size_t i = 0; i < count; i++)
+        {
+            block_header_t* bptr = ptrs[i];
+            if (find_pool_from_pointer(allocator, bptr) == NULL)
+            {
+                continue;
+            }
+
+            bptr->next = first;
+            first = bptr;
+            last = last == NULL ? bptr : last;
+        }
+
+        if (first != NULL)
+        {
+            push_remote_chain(allocator, first, last);
+        }
+        return;
+    }
+
+    if (allocator->thread_cache)
+    {
+        // Magazines are thread-local, so there's nothing to batch
+        for (size_t i = 0; i < count; i++)
+        {
+            pool_header_t* pool = find_pool_from_pointer(allocator, ptrs[i]);
+            if (pool != NULL)
+            {
+                thread_cache_free(allocator, pool, ptrs[i]);
+            }
+        }
+        return;
+    }
+
+    // Group the blocks by pool so each pool's free list is updated once
+    block_header_t* firsts[MAX_NUM_POOLS] = {NULL};
+    block_header_t* lasts[MAX_NUM_POOLS];
+    size_t counts[MAX_NUM_POOLS];
+    for (size_t i = 0; i < count; i++)
+    {
+        group_free_block(allocator, find_pool_from_pointer(allocator, ptrs[i]), ptrs[i], firsts, lasts, counts);
+    }
+
+    push_free_groups(allocator, firsts, lasts, counts);
+}
+
+// ============ REMOTE FREES ===============
+
+bool pool_allocator_set_owner(pool_allocator_t* allocator)
+{
+    if (allocator == NULL || !allocator->initialized)
+    {
+        return false;
+    }
+
+    allocator->owner = pthread_self();
+    allocator->owned = true;
+
+    return true;
+}
+
+size_t pool_allocator_drain_remote_frees(pool_allocator_t* allocator)
+{
+    if (allocator == NULL || !allocator->owned)
+    {
+        return 0;
+    }
+
+    shared_lock(allocator);
+    size_t count = drain_remote_frees(allocator);
+    shared_unlock(allocator);
+
+    return count;
+}
+
+static inline void push_remote_free(pool_allocator_t* allocator, void* ptr)
+{
+    push_remote_chain(allocator, ptr, ptr);
+}
+
+static inline void push_remote_chain(pool_allocator_t* allocator, block_header_t* first, block_header_t* last)
+{
+    // Multi-producer push. The owner detaches the whole queue at once, so there's no ABA to guard against.
+    block_header_t* head = __atomic_load_n(&allocator->remote_free, __ATOMIC_RELAXED);
+    do
+    {
+        __atomic_store_n(&last->next, head, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&allocator->remote_free, &head, first, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static size_t drain_remote_frees(pool_allocator_t* allocator)
+{
+    block_header_t* bptr = __atomic_exchange_n(&allocator->remote_free, NULL, __ATOMIC_ACQUIRE);
+    if (bptr == NULL)
+    {
+        return 0;
+    }
+
+    // Group the detached blocks by pool so each pool's free list is updated once
+    block_header_t* firsts[MAX_NUM_POOLS] = {NULL};
+    block_header_t* lasts[MAX_NUM_POOLS];
+    size_t counts[MAX_NUM_POOLS];
+    size_t count = 0;
+    while (bptr != NULL)
+    {
+        block_header_t* next = bptr->next;
+        group_free_block(allocator, find_pool_from_pointer(allocator, bptr), bptr, firsts, lasts, counts);
+
+        bptr = next;
+        count++;
+    }
+
+    push_free_groups(allocator, firsts, lasts, counts);
+
+    return count;
+}
+
+static inline bool locked_drain_on_miss(pool_allocator_t* allocator)
+{
+    shared_lock(allocator);
+    bool drained = drain_on_miss(allocator);
+    shared_unlock(allocator);
+
+    return drained;
+}
+
+static inline bool drain_on_miss(pool_allocator_t* allocator)
+{
+    // Only the owner consumes its remote-free queue, and only if there's anything in it
+    return allocator->owned && __atomic_load_n(&allocator->remote_free, __ATOMIC_RELAXED) != NULL &&
+           pthread_equal(pthread_self(), allocator->owner) && drain_remote_frees(allocator) > 0;
+}
+
+// ============ THREAD CACHE ===============
+
+bool pool_enable_thread_cache(void)
+{
+    return pool_allocator_enable_thread_cache(&g_default_allocator);
+}
+
+void pool_flush_thread_cache(void)
+{
+    pool_allocator_flush_thread_cache(&g_default_allocator);
+}
+
+bool pool_allocator_enable_thread_cache(pool_allocator_t* allocator)
+{
+    if (allocator == NULL || !allocator->initialized || allocator->thread_cache)
+    {
+        return false;
+    }
+
+    if (pthread_key_create(&allocator->cache_key, destroy_thread_cache) != 0)
+    {
+        return false;
+    }
+
+    // By default every class caches about THREAD_CACHE_BYTES worth of blocks
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        size_t capacity = THREAD_CACHE_BYTES / get_pool(allocator, i)->stride;
+        allocator->cache_capacity[i] = MIN(MAX(capacity, 1), THREAD_CACHE_MAX_BLOCKS);
+    }
+
+    allocator->thread_cache = true;
+
+    return true;
+}
+
+bool pool_allocator_set_cache_capacity(pool_allocator_t* allocator, int class_index, size_t capacity)
+{
+    if (allocator == NULL || !allocator->thread_cache ||
+        class_index < 0 || class_index >= allocator->num_pools)
+    {
+        return false;
+    }
+
+    allocator->cache_capacity[class_index] = capacity;
+
+    return true;
+}
+
+void pool_allocator_flush_thread_cache(pool_allocator_t* allocator)
+{
+    if (allocator == NULL || !allocator->thread_cache)
+    {
+        return;
+    }
+
+    pool_thread_cache_t* cache = pthread_getspecific(allocator->cache_key);
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        flush_thread_cache(allocator, cache, i, 0);
+    }
+}
+
+static void* thread_cache_alloc(pool_allocator_t* allocator, size_t n, pool_header_t** pool)
+{
+    int class_index = find_size_class(allocator, n);
+    if (class_index < 0)
+    {
+        if (POOL_STATS)
+        {
+            stats_failure(allocator, class_index, 1);
+        }
+        *pool = NULL;
+        return NULL;
+    }
+
+    void* ptr = thread_cache_pop(allocator, class_index);
+    *pool = get_pool(allocator, class_index);
+    if (ptr == NULL)
+    {
+        // This class is exhausted (or uncached), so spill into a larger pool
+        shared_lock(allocator);
+        ptr = shared_alloc(allocator, n, pool, NULL);
+        shared_unlock(allocator);
+    }
+
+    return ptr;
+}
+
+static void* thread_cache_pop(pool_allocator_t* allocator, int class_index)
+{
+    pool_thread_cache_t* cache = get_thread_cache(allocator);
+    if (cache != NULL && cache->bins[class_index].head == NULL &&
+        !refill_thread_cache(allocator, cache, class_index) && locked_drain_on_miss(allocator))
+    {
+        refill_thread_cache(allocator, cache, class_index);
+    }
+
+    if (cache == NULL || cache->bins[class_index].head == NULL)
+    {
+        return NULL;
+    }
+
+    // Pop off a cached block without touching any shared state
+    block_header_t* free_block = cache->bins[class_index].head;
+    cache->bins[class_index].head = free_block->next;
+    cache->bins[class_index].count -= 1;
+
+    return (void*)free_block;
+}
+
+static void thread_cache_free(pool_allocator_t* allocator, pool_header_t* pool, void* ptr)
+{
+    int class_index = get_pool_index(allocator, pool);
+
+    pool_thread_cache_t* cache = get_thread_cache(allocator);
+    if (cache == NULL)
+    {
+        shared_lock(allocator);
+        push_free_block(allocator, pool, ptr);
+        shared_unlock(allocator);
+        return;
+    }
+
+    block_header_t* bptr = ptr;
+    bptr->next = cache->bins[class_index].head;
+    cache->bins[class_index].head = bptr;
+    cache->bins[class_index].count += 1;
+
+    // Return the coldest half of an overflowing magazine to the shared pool
+    size_t capacity = allocator->cache_capacity[class_index];
+    if (cache->bins[class_index].count > capacity)
+    {
+        flush_thread_cache(allocator, cache, class_index, capacity / 2);
+    }
+}
+
+// ============ SPANS ===============
+
+size_t pool_allocator_reclaim_spans(pool_allocator_t* allocator)
+{
+    if (allocator == NULL || !allocator->initialized || allocator->spans == NULL)
+    {
+        return 0;
+    }
+
+    shared_lock(allocator);
+    size_t released = reclaim_spans(allocator);
+    shared_unlock(allocator);
+
+    return released;
+}
+
+static bool carve_span(pool_allocator_t* allocator, pool_header_t* pool)
+{
+    byte_ptr_t span = take_span(allocator);
+    if (span == NULL)
+    {
+        return false;
+    }
+
+    // The span is private to this thread until its blocks are pushed onto the pool's free list
+    size_t aligned_block_size = pool->stride;
+    byte_ptr_t last = span + (SPAN_SIZE_BYTES / aligned_block_size - 1) * aligned_block_size;
+    for (byte_ptr_t bptr = span; bptr < last; bptr += aligned_block_size)
+    {
+        __atomic_store_n(&((block_header_t*)bptr)->next, (block_header_t*)(bptr + aligned_block_size),
+                         __ATOMIC_RELAXED);
+    }
+
+    // Unused spans have no live blocks, so only the owning pool changes
+    __atomic_store_n(&get_span(allocator, span)->class_index, (int16_t)get_pool_index(allocator, pool),
+                     __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocator->empty_spans, 1, __ATOMIC_RELAXED);
+
+    // Fresh blocks were never counted as live, so they bypass push_free_chain()
+    if (free_list_push(pool, (block_header_t*)span, (block_header_t*)last) && FREE_POOL_MASK)
+    {
+        mark_pool_free(allocator, pool);
+    }
+
+    return true;
+}
+
+static byte_ptr_t take_span(pool_allocator_t* allocator)
+{
+    while (true)
+    {
+        // Reuse a span another pool gave back before breaking into never used memory
+        byte_ptr_t span = (byte_ptr_t)free_list_pop(&allocator->span_pool);
+        if (span == NULL)
+        {
+            span = claim_fresh_span(&allocator->fresh_spans, allocator->base_addr, allocator->num_spans);
+        }
+
+        pool_chunk_t* chunk = __atomic_load_n(&allocator->chunks, __ATOMIC_ACQUIRE);
+        if (span == NULL && chunk != NULL)
+        {
+            span = claim_fresh_span(&chunk->fresh_spans, chunk->base_addr, chunk->num_spans);
+        }
+
+        if (span != NULL)
+        {
+            return span;
+        }
+
+        // Last resorts before spilling, take back the fully free spans of other pools or grow the heap.
+        // Other threads may beat us to what either of them frees up, in which case we go around again.
+        if (reclaim_spans(allocator) == 0 && !grow_heap(allocator))
+        {
+            return NULL;
+        }
+    }
+}
+
+static inline byte_ptr_t claim_fresh_span(size_t* fresh_spans, byte_ptr_t base, size_t num_spans)
+{
+    size_t index = __atomic_load_n(fresh_spans, __ATOMIC_RELAXED);
+    while (index < num_spans &&
+           !__atomic_compare_exchange_n(fresh_spans, &index, index + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+
+    return index < num_spans ? base + index * SPAN_SIZE_BYTES : NULL;
+}
+
+static size_t reclaim_spans(pool_allocator_t* allocator)
+{
+    if (__atomic_load_n(&allocator->empty_spans, __ATOMIC_RELAXED) <= 0 ||
+        __atomic_exchange_n(&allocator->reclaiming, true, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    // Only pools holding spans without live blocks are worth detaching
+    uint64_t donors = find_span_donors(allocator->spans, allocator->num_spans);
+    for (pool_chunk_t* chunk = __atomic_load_n(&allocator->chunks, __ATOMIC_ACQUIRE); chunk != NULL; chunk = chunk->next)
+    {
+        donors |= find_span_donors(chunk->spans, chunk->num_spans);
+    }
+
+    // Detach the donors' whole free lists, so that none of their blocks can be popped while we count
+    // them by span. A span is only fully free if every one of its blocks turns up in these chains.
+    block_header_t* chains[MAX_NUM_POOLS] = {NULL};
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        if ((donors >> i) & 1)
+        {
+            chains[i] = free_list_detach(get_pool(allocator, i));
+        }
+
+        for (block_header_t* bptr = chains[i]; bptr != NULL; bptr = bptr->next)
+        {
+            get_span(allocator, bptr)->free_count++;
+        }
+    }
+
+    // Put back every block of the spans that are still in use
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        block_header_t* first = NULL;
+        block_header_t* last = NULL;
+        for (block_header_t* bptr = chains[i]; bptr != NULL; bptr = bptr->next)
+        {
+            if (span_is_free(allocator, get_span(allocator, bptr)))
+            {
+                continue;
+            }
+
+            if (last == NULL)
+            {
+                first = bptr;
+            }
+            else
+            {
+                __atomic_store_n(&last->next, bptr, __ATOMIC_RELAXED);
+            }
+            last = bptr;
+        }
+
+        // These blocks were never counted as live either
+        pool_header_t* pool = get_pool(allocator, i);
+        if (first != NULL && free_list_push(pool, first, last) && FREE_POOL_MASK)
+        {
+            mark_pool_free(allocator, pool);
+        }
+    }
+
+    // And hand the fully free spans over to the span pool. Chunks added since we reset the counts may
+    // have blocks in the chains too, but their counts started out at zero, so look at every chunk again.
+    size_t released = release_free_spans(allocator, allocator->spans, allocator->base_addr, allocator->num_spans);
+    for (pool_chunk_t* chunk = __atomic_load_n(&allocator->chunks, __ATOMIC_ACQUIRE); chunk != NULL; chunk = chunk->next)
+    {
+        released += release_free_spans(allocator, chunk->spans, chunk->base_addr, chunk->num_spans);
+    }
+
+    __atomic_store_n(&allocator->reclaiming, false, __ATOMIC_RELEASE);
+
+    return released;
+}
+
+static uint64_t find_span_donors(span_header_t* spans, size_t num_spans)
+{
+    uint64_t donors = 0;
+    for (size_t i = 0; i < num_spans; i++)
+    {
+        span_header_t* span = &spans[i];
+        int class_index = __atomic_load_n(&span->class_index, __ATOMIC_RELAXED);
+        span->free_count = 0;
+        if (class_index >= 0 && __atomic_load_n(&span->live, __ATOMIC_RELAXED) == 0)
+        {
+            donors |= UINT64_C(1) << class_index;
+        }
+    }
+
+    return donors;
+}
+
+static size_t release_free_spans(pool_allocator_t* allocator, span_header_t* spans, byte_ptr_t base,
+                                 size_t num_spans)
+{
+    size_t released = 0;
+    for (size_t i = 0; i < num_spans; i++)
+    {
+        span_header_t* span = &spans[i];
+        if (__atomic_load_n(&span->class_index, __ATOMIC_RELAXED) < 0 || !span_is_free(allocator, span))
+        {
+            continue;
+        }
+
+        block_header_t* bptr = (block_header_t*)(base + i * SPAN_SIZE_BYTES);
+        __atomic_store_n(&span->class_index, -1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&allocator->empty_spans, 1, __ATOMIC_RELAXED);
+        free_list_push(&allocator->span_pool, bptr, bptr);
+        released++;
+    }
+
+    return released;
+}
+
+static inline bool span_is_free(pool_allocator_t* allocator, span_header_t* span)
+{
+    int class_index = __atomic_load_n(&span->class_index, __ATOMIC_RELAXED);
+    return class_index >= 0 && span->free_count == SPAN_SIZE_BYTES / get_pool(allocator, class_index)->stride &&
+           __atomic_load_n(&span->live, __ATOMIC_RELAXED) == 0;
+}
+
+static inline void count_span_block(pool_allocator_t* allocator, void* ptr, int32_t delta)
+{
+    // Keep count of the spans without live blocks, so reclaim_spans() can tell when there's nothing to find
+    int32_t live = __atomic_add_fetch(&get_span(allocator, ptr)->live, delta, __ATOMIC_RELAXED);
+    if (live == 0)
+    {
+        __atomic_fetch_add(&allocator->empty_spans, 1, __ATOMIC_RELAXED);
+    }
+    else if (live == delta)
+    {
+        __atomic_fetch_sub(&allocator->empty_spans, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void count_span_chain(pool_allocator_t* allocator, block_header_t* first, block_header_t* last,
+                                    int32_t delta)
+{
+    // Neighbouring blocks in a chain usually share a span, so count them a run at a time
+    block_header_t* run = first;
+    int32_t run_delta = 0;
+    for (block_header_t* bptr = first;; bptr = bptr->next)
+    {
+        if (get_span(allocator, bptr) != get_span(allocator, run))
+        {
+            count_span_block(allocator, run, run_delta);
+            run = bptr;
+            run_delta = 0;
+        }
+        run_delta += delta;
+
+        if (bptr == last)
+        {
+            break;
+        }
+    }
+
+    count_span_block(allocator, run, run_delta);
+}
+
+static inline span_header_t* get_span(pool_allocator_t* allocator, void* ptr)
+{
+    byte_ptr_t bptr = (byte_ptr_t)ptr;
+    if (bptr >= allocator->base_addr && bptr < allocator->end_addr)
+    {
+        return allocator->spans + ((bptr - allocator->base_addr) >> SPAN_SHIFT);
+    }
+
+    return find_chunk_span(allocator, ptr);
+}
+
+static inline bool grow_pool(pool_allocator_t* allocator, pool_header_t* pool)
+{
+    return allocator->spans != NULL && carve_span(allocator, pool);
+}
+
+static inline bool grow_fitting_pool(pool_allocator_t* allocator, size_t n)
+{
+    return allocator->spans != NULL && carve_span(allocator, get_pool(allocator, find_size_class(allocator, n)));
+}
+
+// ============ HEAP GROWTH ===============
+
+bool pool_set_growth(const pool_growth_t* growth)
+{
+    return pool_allocator_set_growth(&g_default_allocator, growth);
+}
+
+bool pool_allocator_set_growth(pool_allocator_t* allocator, const pool_growth_t* growth)
+{
+    // Only span heaps can take in discontiguous memory, as their pools are made of scattered spans anyway
+    if (allocator == NULL || !allocator->initialized || allocator->spans == NULL || growth == NULL ||
+        !(growth->growth_factor >= 1.0) || __atomic_load_n(&allocator->page_map, __ATOMIC_ACQUIRE) != NULL)
+    {
+        return false;
+    }
+
+    struct page_map* page_map = calloc(1, sizeof(struct page_map));
+    if (page_map == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&allocator->growth_lock);
+    allocator->growth = *growth;
+    allocator->next_chunk_size = growth->chunk_size ? growth->chunk_size : allocator->heap_size;
+    __atomic_store_n(&allocator->page_map, page_map, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&allocator->growth_lock);
+
+    return true;
+}
+
+static inline span_header_t* find_chunk_span(pool_allocator_t* allocator, void* ptr)
+{
+    page_map_leaf_t* leaf = find_page_map_leaf(allocator, ptr);
+    if (leaf == NULL)
+    {
+        return NULL;
+    }
+
+    return __atomic_load_n(&leaf->spans[((uintptr_t)ptr >> SPAN_SHIFT) & PAGE_MAP_MASK], __ATOMIC_ACQUIRE);
+}
+
+static inline pool_chunk_t* find_chunk(pool_allocator_t* allocator, void* ptr)
+{
+    page_map_leaf_t* leaf = find_page_map_leaf(allocator, ptr);
+    if (leaf == NULL)
+    {
+        return NULL;
+    }
+
+    return __atomic_load_n(&leaf->chunks[((uintptr_t)ptr >> SPAN_SHIFT) & PAGE_MAP_MASK], __ATOMIC_ACQUIRE);
+}
+
+static inline page_map_leaf_t* find_page_map_leaf(pool_allocator_t* allocator, void* ptr)
+{
+    uintptr_t page = (uintptr_t)ptr >> SPAN_SHIFT;
+    struct page_map* page_map = __atomic_load_n(&allocator->page_map, __ATOMIC_ACQUIRE);
+    if (page_map == NULL)
+    {
+        return NULL;
+    }
+
+    page_map_node_t* node = __atomic_load_n(&page_map->nodes[(page >> (2 * PAGE_MAP_BITS)) & PAGE_MAP_MASK],
+                                            __ATOMIC_ACQUIRE);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    return __atomic_load_n(&node->leaves[(page >> PAGE_MAP_BITS) & PAGE_MAP_MASK], __ATOMIC_ACQUIRE);
+}
+
+static inline bool heap_contains(pool_allocator_t* allocator, void* ptr)
+{
+    // Blocks given out of the trailing region lie past end_addr, so check against the whole heap
+    byte_ptr_t bptr = (byte_ptr_t)ptr;
+    return (bptr >= allocator->heap && bptr < allocator->heap + allocator->heap_size) || find_chunk_span(allocator, ptr) != NULL;
+}
+
+static bool grow_heap(pool_allocator_t* allocator)
+{
+    if (__atomic_load_n(&allocator->page_map, __ATOMIC_ACQUIRE) == NULL)
+    {
+        return false;
+    }
+
+    // Another thread may have grown the heap while we waited for the lock
+    pthread_mutex_lock(&allocator->growth_lock);
+    pool_chunk_t* newest = allocator->chunks;
+    bool grown = (newest != NULL && __atomic_load_n(&newest->fresh_spans, __ATOMIC_RELAXED) < newest->num_spans) ||
+                 add_chunk(allocator);
+    pthread_mutex_unlock(&allocator->growth_lock);
+
+    return grown;
+}
+
+static bool add_chunk(pool_allocator_t* allocator)
+{
+    // Chunks grow geometrically up to the per-chunk cap, and the last one gets whatever the heap cap leaves
+    pool_growth_t* growth = &allocator->growth;
+    size_t size = allocator->next_chunk_size;
+    if (growth->max_chunk_size)
+    {
+        size = MIN(size, growth->max_chunk_size);
+    }
+
+    size_t next_size = (double)size * growth->growth_factor >= (double)SIZE_MAX ? SIZE_MAX
+                                                                                 : (size_t)(size * growth->growth_factor);
+    if (growth->max_heap_size)
+    {
+        size_t used = allocator->heap_size + allocator->chunk_bytes;
+        size = MIN(size, used < growth->max_heap_size ? growth->max_heap_size - used : 0);
+    }
+
+    if (size < sizeof(pool_chunk_t) + sizeof(span_header_t) + SPAN_SIZE_BYTES)
+    {
+        return false;
+    }
+
+    void* memory;
+    if (growth->chunk_alloc != NULL)
+    {
+        memory = growth->chunk_alloc(size, growth->context);
+    }
+    else
+    {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        memory = memory == MAP_FAILED ? NULL : memory;
+    }
+
+    if (memory == NULL)
+    {
+        return false;
+    }
+
+    // Lay the chunk out like a span heap behind its descriptor
+    pool_chunk_t* chunk = (pool_chunk_t*)aligned((uintptr_t)memory, byte_align);
+    byte_ptr_t start = (byte_ptr_t)(chunk + 1);
+    span_header_t* table;
+    byte_ptr_t base;
+    size_t num_spans = plan_span_table(start, size - (size_t)(start - (byte_ptr_t)memory), &table, &base);
+
+    // Make room in the page map for every span before entering any, so a failure leaves no dangling entries
+    struct page_map* page_map = allocator->page_map;
+    bool mapped = num_spans > 0;
+    for (size_t i = 0; mapped && i < num_spans; i++)
+    {
+        uintptr_t page = (uintptr_t)(base + i * SPAN_SIZE_BYTES) >> SPAN_SHIFT;
+        page_map_node_t** node = &page_map->nodes[(page >> (2 * PAGE_MAP_BITS)) & PAGE_MAP_MASK];
+        if (*node == NULL)
+        {
+            page_map_node_t* new_node = calloc(1, sizeof(page_map_node_t));
+            mapped = new_node != NULL;
+            __atomic_store_n(node, new_node, __ATOMIC_RELEASE);
+        }
+
+        page_map_leaf_t** leaf = mapped ? &(*node)->leaves[(page >> PAGE_MAP_BITS) & PAGE_MAP_MASK] : NULL;
+        if (mapped && *leaf == NULL)
+        {
+            page_map_leaf_t* new_leaf = calloc(1, sizeof(page_map_leaf_t));
+            mapped = new_leaf != NULL;
+            __atomic_store_n(leaf, new_leaf, __ATOMIC_RELEASE);
+        }
+    }
+
+    if (!mapped)
+    {
+        if (growth->chunk_alloc == NULL)
+        {
+            munmap(memory, size);
+        }
+        else if (growth->chunk_free != NULL)
+        {
+            growth->chunk_free(memory, size, growth->context);
+        }
+
+        return false;
+    }
+
+    *chunk = (pool_chunk_t){
+        .next = allocator->chunks,
+        .memory = memory,
+        .size = size,
+        .spans = table,
+        .base_addr = base,
+        .num_spans = num_spans,
+        .fresh_spans = 0,
+        .index = allocator->chunks == NULL ? 1 : allocator->chunks->index + 1,
+    };
+
+    for (size_t i = 0; i < num_spans; i++)
+    {
+        uintptr_t page = (uintptr_t)(base + i * SPAN_SIZE_BYTES) >> SPAN_SHIFT;
+        page_map_leaf_t* leaf =
+            page_map->nodes[(page >> (2 * PAGE_MAP_BITS)) & PAGE_MAP_MASK]->leaves[(page >> PAGE_MAP_BITS) & PAGE_MAP_MASK];
+        __atomic_store_n(&leaf->chunks[page & PAGE_MAP_MASK], chunk, __ATOMIC_RELEASE);
+        __atomic_store_n(&leaf->spans[page & PAGE_MAP_MASK], &table[i], __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&allocator->chunks, chunk, __ATOMIC_RELEASE);
+    allocator->chunk_bytes += size;
+    allocator->next_chunk_size = next_size;
+
+    return true;
+}
+
+static void release_chunks(pool_allocator_t* allocator)
+{
+    pool_growth_t* growth = &allocator->growth;
+    pool_chunk_t* chunk = allocator->chunks;
+    while (chunk != NULL)
+    {
+        // The descriptor lives in the chunk itself
+        pool_chunk_t* next = chunk->next;
+        if (growth->chunk_alloc == NULL)
+        {
+            munmap(chunk->memory, chunk->size);
+        }
+        else if (growth->chunk_free != NULL)
+        {
+            growth->chunk_free(chunk->memory, chunk->size, growth->context);
+        }
+
+        chunk = next;
+    }
+
+    struct page_map* page_map = allocator->page_map;
+    for (size_t i = 0; page_map != NULL && i < (1 << PAGE_MAP_BITS); i++)
+    {
+        for (size_t j = 0; page_map->nodes[i] != NULL && j < (1 << PAGE_MAP_BITS); j++)
+        {
+            free(page_map->nodes[i]->leaves[j]);
+        }
+
+        free(page_map->nodes[i]);
+    }
+
+    free(page_map);
+    allocator->page_map = NULL;
+    allocator->chunks = NULL;
+    allocator->chunk_bytes = 0;
+}
+
+// ============ TRAILING REGION ===============
+
+void* pool_alloc_trailing(size_t n)
+{
+    return pool_allocator_alloc_trailing(&g_default_allocator, n);
+}
+
+size_t pool_give_trailing(int class_id)
+{
+    return pool_allocator_give_trailing(&g_default_allocator, class_id);
+}
+
+void* pool_allocator_alloc_trailing(pool_allocator_t* allocator, size_t n)
+{
+    if (allocator == NULL || !allocator->initialized || allocator->spans != NULL || n == 0)
+    {
+        return NULL;
+    }
+
+    size_t size = trailing_size(allocator);
+    size_t bytes = align(n);
+    size_t used = __atomic_load_n(&allocator->trailing_used, __ATOMIC_RELAXED);
+    do
+    {
+        if (bytes > size - used)
+        {
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&allocator->trailing_used, &used, used + bytes, true, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    return allocator->end_addr + used;
+}
+
+size_t pool_allocator_give_trailing(pool_allocator_t* allocator, int class_id)
+{
+    if (allocator == NULL || !allocator->initialized || allocator->spans != NULL || class_id < 0 ||
+        class_id >= allocator->num_pools)
+    {
+        return 0;
+    }
+
+    // Claiming the rest of the region at once leaves later bump allocations and calls with nothing
+    pool_header_t* pool = get_pool(allocator, class_id);
+    size_t size = trailing_size(allocator);
+    size_t piece_size = pool->stride;
+    size_t used = __atomic_exchange_n(&allocator->trailing_used, size, __ATOMIC_RELAXED);
+    byte_ptr_t first = (byte_ptr_t)aligned((uintptr_t)allocator->end_addr + used, allocator->alignments[class_id]);
+    byte_ptr_t end = allocator->end_addr + size;
+    size_t count = first < end ? (size_t)(end - first) / piece_size : 0;
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // Frees must find the class before they can meet any of its blocks
+    byte_ptr_t last = first + (count - 1) * piece_size;
+    allocator->trailing_class = class_id;
+    __atomic_store_n(&allocator->trailing_blocks, first, __ATOMIC_RELEASE);
+    for (byte_ptr_t bptr = first; bptr < last; bptr += piece_size)
+    {
+        ((block_header_t*)bptr)->next = (block_header_t*)(bptr + piece_size);
+    }
+
+    if (free_list_push(pool, (block_header_t*)first, (block_header_t*)last) && FREE_POOL_MASK)
+    {
+        mark_pool_free(allocator, pool);
+    }
+
+    return count;
+}
+
+static inline size_t trailing_size(pool_allocator_t* allocator)
+{
+    return (size_t)(allocator->heap + allocator->heap_size - allocator->end_addr);
+}
+
+// ============ BLOCK SPLITTING ===============
+
+bool pool_enable_splitting(void)
+{
+    return pool_allocator_enable_splitting(&g_default_allocator);
+}
+
+bool pool_allocator_enable_splitting(pool_allocator_t* allocator)
+{
+    if (allocator == NULL || !allocator->initialized || allocator->spans != NULL || allocator->splits != NULL)
+    {
+        return false;
+    }
+
+    size_t num_blocks = 0;
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        num_blocks += get_pool(allocator, i)->num_blocks;
+    }
+
+    struct pool_split_data* splits = calloc(1, sizeof(*splits) + num_blocks);
+    if (splits == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 1; i < allocator->num_pools; i++)
+    {
+        splits->first_block[i] = splits->first_block[i - 1] + get_pool(allocator, i - 1)->num_blocks;
+    }
+
+    __atomic_store_n(&allocator->splits, splits, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static bool split_block(pool_allocator_t* allocator, pool_header_t* pool, size_t n)
+{
+    struct pool_split_data* splits = allocator->splits;
+    if (splits == NULL || pool == NULL)
+    {
+        return false;
+    }
+
+    int class_index = find_size_class(allocator, n);
+    pool_header_t* target = get_pool(allocator, class_index);
+    size_t aligned_block_size = pool->stride;
+    size_t piece_size = target->stride;
+    size_t num_pieces = aligned_block_size / piece_size;
+    int pool_index = get_pool_index(allocator, pool);
+    if (num_pieces < 2 || allocator->alignments[class_index] > allocator->alignments[pool_index])
+    {
+        return false;
+    }
+
+    byte_ptr_t block = (byte_ptr_t)pop_free_block(allocator, pool, NULL);
+    if (block == NULL)
+    {
+        return false;
+    }
+
+    // Pieces of an already split block are left to spill whole, so every block needs only one entry
+    byte_ptr_t pool_start = allocator->base_addr + pool_start_offset(allocator, pool_index);
+    if (block < pool_start || block >= allocator->base_addr + pool_end_offset(allocator, pool_index))
+    {
+        if (free_list_push(pool, (block_header_t*)block, (block_header_t*)block) && FREE_POOL_MASK)
+        {
+            mark_pool_free(allocator, pool);
+        }
+        return false;
+    }
+
+    // The block is private to this thread until its pieces are pushed, which publishes the entry along with them
+    size_t index = divide_offset((size_t)(block - pool_start), aligned_block_size, pool->reciprocal);
+    __atomic_store_n(&splits->classes[splits->first_block[pool_index] + index], (uint8_t)(class_index + 1),
+                     __ATOMIC_RELAXED);
+
+    byte_ptr_t last = block + (num_pieces - 1) * piece_size;
+    for (byte_ptr_t bptr = block; bptr < last; bptr += piece_size)
+    {
+        __atomic_store_n(&((block_header_t*)bptr)->next, (block_header_t*)(bptr + piece_size), __ATOMIC_RELAXED);
+    }
+
+    if (free_list_push(target, (block_header_t*)block, (block_header_t*)last) && FREE_POOL_MASK)
+    {
+        mark_pool_free(allocator, target);
+    }
+
+    return true;
+}
+
+static inline pool_header_t* find_split_pool(pool_allocator_t* allocator, pool_header_t* pool, void* ptr)
+{
+    struct pool_split_data* splits = allocator->splits;
+    int pool_index = get_pool_index(allocator, pool);
+    size_t index = divide_offset((size_t)((byte_ptr_t)ptr - pool->first_block), pool->stride, pool->reciprocal);
+    if (index >= pool->num_blocks)
+    {
+        return pool;
+    }
+
+    uint8_t split = __atomic_load_n(&splits->classes[splits->first_block[pool_index] + index], __ATOMIC_RELAXED);
+    return split == 0 ? pool : get_pool(allocator, split - 1);
+}
+
+// ============ PROFILING ===============
+
+bool pool_enable_profiling(void)
+{
+    return pool_allocator_enable_profiling(&g_default_allocator);
+}
+
+bool pool_get_profile(pool_profile_t* profile)
+{
+    return pool_allocator_get_profile(&g_default_allocator, profile);
+}
+
+bool pool_recommend_config(pool_recommendation_t* recommendation)
+{
+    return pool_allocator_recommend_config(&g_default_allocator, recommendation);
+}
+
+bool pool_allocator_enable_profiling(pool_allocator_t* allocator)
+{
+    if (allocator == NULL || !allocator->initialized || allocator->profile != NULL)
+    {
+        return false;
+    }
+
+    struct pool_profile_data* profile = calloc(1, sizeof(*profile));
+    if (profile == NULL)
+    {
+        return false;
+    }
+
+    __atomic_store_n(&allocator->profile, profile, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool pool_allocator_get_profile(pool_allocator_t* allocator, pool_profile_t* profile)
+{
+    if (allocator == NULL || allocator->profile == NULL || profile == NULL)
+    {
+        return false;
+    }
+
+    struct pool_profile_data* data = allocator->profile;
+    uint64_t histogram[PROFILE_BUCKETS];
+    uint64_t requests[MAX_NUM_POOLS];
+    profile_requests(allocator, histogram, requests);
+
+    memset(profile, 0, sizeof(*profile));
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        profile->requests[i] = requests[i];
+        profile->overflows[i] = __atomic_load_n(&data->overflows[i], __ATOMIC_RELAXED);
+        profile->peak_live[i] = __atomic_load_n(&data->peak_live[i], __ATOMIC_RELAXED);
+    }
+    profile->oversized = __atomic_load_n(&data->oversized, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+bool pool_allocator_recommend_config(pool_allocator_t* allocator, pool_recommendation_t* recommendation)
+{
+    if (allocator == NULL || allocator->profile == NULL || recommendation == NULL)
+    {
+        return false;
+    }
+
+    struct pool_profile_data* data = allocator->profile;
+
+    uint64_t histogram[PROFILE_BUCKETS];
+    uint64_t class_requests[MAX_NUM_POOLS];
+    profile_requests(allocator, histogram, class_requests);
+
+    // Estimate the peak live blocks of every requested size by sharing out its class's peak
+    size_t sizes[PROFILE_BUCKETS];
+    double live[PROFILE_BUCKETS];
+    size_t num_sizes = 0;
+    for (size_t b = 0; b < PROFILE_BUCKETS; b++)
+    {
+        size_t size = profile_bucket_size(b);
+        if (histogram[b] == 0 || size > SIZE_MAX / 2)
+        {
+            continue;
+        }
+
+        // Requests no class fits never became live blocks, so count them all as live at once
+        int class_index = find_size_class(allocator, size);
+        double peak = class_index < 0 ? (double)histogram[b]
+                                      : (double)__atomic_load_n(&data->peak_live[class_index], __ATOMIC_RELAXED) *
+                                            histogram[b] / class_requests[class_index];
+
+        sizes[num_sizes] = align(size);
+        live[num_sizes] = peak;
+        num_sizes++;
+    }
+
+    if (num_sizes == 0)
+    {
+        return false;
+    }
+
+    // Partition the sorted sizes into at most MAX_NUM_POOLS classes, each serving the sizes below it
+    // with blocks of its largest size. cost[k][i] is the least footprint of the first i + 1 sizes
+    // using k + 1 classes, the largest ending at size i.
+    size_t max_classes = MIN(num_sizes, (size_t)MAX_NUM_POOLS);
+    double(*cost)[PROFILE_BUCKETS] = malloc(max_classes * sizeof(*cost));
+    uint16_t(*split)[PROFILE_BUCKETS] = malloc(max_classes * sizeof(*split));
+    double* prefix = malloc((num_sizes + 1) * sizeof(*prefix));
+    if (cost == NULL || split == NULL || prefix == NULL)
+    {
+        free(cost);
+        free(split);
+        free(prefix);
+        return false;
+    }
+
+    prefix[0] = 0;
+    for (size_t i = 0; i < num_sizes; i++)
+    {
+        prefix[i + 1] = prefix[i] + live[i];
+    }
+
+    for (size_t i = 0; i < num_sizes; i++)
+    {
+        cost[0][i] = sizeof(pool_header_t) + prefix[i + 1] * sizes[i];
+    }
+
+    size_t best_classes = 1;
+    for (size_t k = 1; k < max_classes; k++)
+    {
+        for (size_t i = k; i < num_sizes; i++)
+        {
+            cost[k][i] = -1;
+            for (size_t j = k - 1; j < i; j++)
+            {
+                double c = cost[k - 1][j] + sizeof(pool_header_t) + (prefix[i + 1] - prefix[j + 1]) * sizes[i];
+                if (cost[k][i] < 0 || c < cost[k][i])
+                {
+                    cost[k][i] = c;
+                    split[k][i] = (uint16_t)j;
+                }
+            }
+        }
+
+        if (cost[k][num_sizes - 1] < cost[best_classes - 1][num_sizes - 1])
+        {
+            best_classes = k + 1;
+        }
+    }
+
+    // Walk the splits back from the largest size
+    memset(recommendation, 0, sizeof(*recommendation));
+    recommendation->block_size_count = best_classes;
+    recommendation->heap_size = best_classes * sizeof(pool_header_t);
+    size_t end = num_sizes - 1;
+    for (size_t k = best_classes; k-- > 0;)
+    {
+        size_t start = k == 0 ? 0 : (size_t)split[k][end] + 1;
+        double blocks = prefix[end + 1] - prefix[start];
+
+        recommendation->block_sizes[k] = sizes[end];
+        recommendation->block_counts[k] = MAX((size_t)(blocks + 0.999), 1);
+        recommendation->heap_size += recommendation->block_counts[k] * sizes[end];
+        end = start - 1;
+    }
+
+    free(cost);
+    free(split);
+    free(prefix);
+
+    return true;
+}
+
+static void profile_alloc(pool_allocator_t* allocator, pool_header_t* pool, size_t n)
+{
+    struct pool_profile_data* profile = allocator->profile;
+    profile_count(&profile->histogram[profile_bucket(n)]);
+
+    if (pool == NULL)
+    {
+        // Failed requests count against the class that should have served them, if any
+        int class_index = find_size_class(allocator, n);
+        profile_count(class_index < 0 ? &profile->oversized : &profile->overflows[class_index]);
+        return;
+    }
+
+    // Blocks that spilled into a larger pool count against the class they fit, but are live in the pool
+    // they landed in, which is the one they're freed back to
+    int pool_index = get_pool_index(allocator, pool);
+    if (pool_index > 0 && allocator->class_sizes[pool_index - 1] >= n)
+    {
+        profile_count(&profile->overflows[find_size_class(allocator, n)]);
+    }
+
+    int64_t live = __atomic_add_fetch(&profile->live[pool_index], 1, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&profile->peak_live[pool_index], __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&profile->peak_live[pool_index], &peak, live, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static void profile_free(pool_allocator_t* allocator, pool_header_t* pool)
+{
+    if (pool != NULL)
+    {
+        __atomic_fetch_sub(&allocator->profile->live[get_pool_index(allocator, pool)], 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void profile_requests(pool_allocator_t* allocator, uint64_t* histogram, uint64_t* class_requests)
+{
+    // Buckets map onto the class fitting their largest size, so classes that aren't multiples of 8 bytes
+    // (or that split a power of two bucket) share their bucket's requests with the next class up
+    memset(class_requests, 0, MAX_NUM_POOLS * sizeof(*class_requests));
+    for (size_t b = 0; b < PROFILE_BUCKETS; b++)
+    {
+        histogram[b] = __atomic_load_n(&allocator->profile->histogram[b], __ATOMIC_RELAXED);
+        int class_index = find_size_class(allocator, profile_bucket_size(b));
+        if (class_index >= 0)
+        {
+            class_requests[class_index] += histogram[b];
+        }
+    }
+}
+
+static inline void profile_count(uint64_t* counter)
+{
+    // A locked increment would cost more than the allocation itself, so racing threads may drop counts
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+static inline void stats_alloc(pool_header_t* pool, size_t count)
+{
+    // Live blocks are derived from the two counters, so only a new peak costs a third store
+    pool_head_t* head = pool->head;
+    stats_count(&head->allocs, count);
+    uint64_t live = __atomic_load_n(&head->allocs, __ATOMIC_RELAXED) - __atomic_load_n(&head->frees, __ATOMIC_RELAXED);
+    if ((int64_t)live > (int64_t)__atomic_load_n(&head->peak_live, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&head->peak_live, live, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void stats_count(uint64_t* counter, size_t count)
+{
+    // Like profile_count(), a locked add would cost as much as the allocation itself
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + count, __ATOMIC_RELAXED);
+}
+
+static void stats_failure(pool_allocator_t* allocator, int class_index, size_t count)
+{
+    stats_count(class_index < 0 ? &allocator->oversized : &get_pool(allocator, class_index)->head->failures, count);
+}
+
+static inline bool recording(pool_allocator_t* allocator)
+{
+    return allocator->profile != NULL || allocator->trace != NULL;
+}
+
+static void record_alloc(pool_allocator_t* allocator, pool_header_t* pool, size_t n, void* ptr)
+{
+    if (allocator->profile != NULL)
+    {
+        profile_alloc(allocator, pool, n);
+    }
+
+    if (allocator->trace != NULL)
+    {
+        trace_alloc(allocator, pool, n, ptr);
+    }
+}
+
+static void record_free(pool_allocator_t* allocator, pool_header_t* pool, void* ptr)
+{
+    if (allocator->profile != NULL)
+    {
+        profile_free(allocator, pool);
+    }
+
+    if (allocator->trace != NULL && pool != NULL)
+    {
+        trace_event(allocator, POOL_TRACE_FREE, 0, get_pool_index(allocator, pool), ptr);
+    }
+}
+
+static void trace_alloc(pool_allocator_t* allocator, pool_header_t* pool, size_t n, void* ptr)
+{
+    if (ptr == NULL)
+    {
+        // Failures are recorded against the class that should have served them, if any
+        int class_index = find_size_class(allocator, n);
+        trace_event(allocator, POOL_TRACE_FAIL, n, class_index < 0 ? POOL_TRACE_NO_POOL : class_index, NULL);
+        dump_trace_on_failure(allocator);
+        return;
+    }
+
+    int pool_index = get_pool_index(allocator, pool);
+    bool spilled = pool_index > 0 && allocator->class_sizes[pool_index - 1] >= n;
+    trace_event(allocator, POOL_TRACE_ALLOC | (spilled ? POOL_TRACE_SPILL : 0), n, pool_index, ptr);
+}
+
+static inline void trace_event(pool_allocator_t* allocator, uint8_t op, size_t n, int pool_index, void* ptr)
+{
+    struct pool_trace_data* trace = allocator->trace;
+    byte_ptr_t bptr = (byte_ptr_t)ptr;
+    size_t offset = POOL_TRACE_NO_OFFSET;
+    size_t chunk_index = 0;
+    if (bptr >= allocator->heap && bptr < allocator->heap + allocator->heap_size)
+    {
+        offset = MIN((size_t)(bptr - allocator->heap), POOL_TRACE_NO_OFFSET);
+    }
+    else if (bptr != NULL)
+    {
+        // Blocks of growth chunks are placed by chunk, so they can be told apart like those of the heap
+        pool_chunk_t* chunk = find_chunk(allocator, ptr);
+        if (chunk != NULL && chunk->index <= POOL_TRACE_MAX_CHUNK)
+        {
+            offset = MIN((size_t)(bptr - (byte_ptr_t)chunk->memory), POOL_TRACE_NO_OFFSET);
+            chunk_index = chunk->index;
+        }
+    }
+
+    pool_trace_event_t event = {
+        .time = trace_ticks() - trace->start_ticks,
+        .chunk = chunk_index,
+        .offset = (uint32_t)offset,
+        .size = (uint16_t)MIN(n, UINT16_MAX),
+        .op = op,
+        .pool_index = (uint8_t)pool_index,
+    };
+
+    // Like the statistics, the slot is claimed without a locked instruction, so racing threads may
+    // overwrite each other's event. The event itself is a single 16-byte store within one cache line.
+    uint64_t slot = __atomic_load_n(&trace->next, __ATOMIC_RELAXED);
+    __atomic_store_n(&trace->next, slot + 1, __ATOMIC_RELAXED);
+    trace->events[slot & trace->mask] = event;
+}
+
+static void dump_trace_on_failure(pool_allocator_t* allocator)
+{
+    struct pool_trace_data* trace = allocator->trace;
+    if (trace->failure_path == NULL)
+    {
+        return;
+    }
+
+    // A pool running dry fails over and over, so only dump again once the ring holds nothing but new events
+    uint64_t next = __atomic_load_n(&trace->next, __ATOMIC_RELAXED);
+    uint64_t dumped_at = __atomic_load_n(&trace->dumped_at, __ATOMIC_RELAXED);
+    if ((dumped_at == 0 || next - dumped_at > trace->mask) &&
+        __atomic_compare_exchange_n(&trace->dumped_at, &dumped_at, next, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        pool_allocator_dump_trace(allocator, trace->failure_path);
+    }
+}
+
+static inline uint64_t trace_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static uint64_t trace_ticks_per_second(pool_allocator_t* allocator)
+{
+    // Calibrate the tick rate against the monotonic clock over the time tracing has been on
+    struct pool_trace_data* trace = allocator->trace;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ticks = trace_ticks() - trace->start_ticks;
+    double seconds = (double)(now.tv_sec - trace->start_time.tv_sec) + (now.tv_nsec - trace->start_time.tv_nsec) * 1e-9;
+
+    return seconds > 0 ? (uint64_t)(ticks / seconds) : 0;
+}
+
+static void release_trace(pool_allocator_t* allocator)
+{
+    struct pool_trace_data* trace = allocator->trace;
+    if (trace != NULL)
+    {
+        free(trace->events);
+        free(trace->failure_path);
+        free(trace);
+    }
+}
+
+static size_t profile_bucket(size_t n)
+{
+    if (n <= PROFILE_GRANULE_MAX)
+    {
+        return (n + 7) >> 3;
+    }
+
+    // Bucket of the smallest power of two holding n
+    return PROFILE_GRANULE_BUCKETS + (64 - __builtin_clzll((unsigned long long)n - 1)) - 1;
+}
+
+static size_t profile_bucket_size(size_t bucket)
+{
+    if (bucket < PROFILE_GRANULE_BUCKETS)
+    {
+        return bucket << 3;
+    }
+
+    size_t shift = bucket - PROFILE_GRANULE_BUCKETS + 1;
+    return shift < sizeof(size_t) * 8 ? (size_t)1 << shift : SIZE_MAX;
+}
+
+// ============ STATISTICS ===============
+
+bool pool_get_stats(pool_stats_t* stats)
+{
+    return pool_allocator_get_stats(&g_default_allocator, stats);
+}
+
+bool pool_allocator_get_stats(pool_allocator_t* allocator, pool_stats_t* stats)
+{
+    if (!POOL_STATS || allocator == NULL || !allocator->initialized || stats == NULL)
+    {
+        return false;
+    }
+
+    memset(stats, 0, sizeof(pool_stats_t));
+    stats->num_classes = (size_t)allocator->num_pools;
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        pool_header_t* pool = get_pool(allocator, i);
+        pool_head_t* head = pool->head;
+        stats->block_sizes[i] = pool->block_size;
+        stats->frees[i] = __atomic_load_n(&head->frees, __ATOMIC_RELAXED);
+        stats->allocs[i] = __atomic_load_n(&head->allocs, __ATOMIC_RELAXED);
+        stats->live[i] = stats->allocs[i] > stats->frees[i] ? stats->allocs[i] - stats->frees[i] : 0;
+        stats->peak_live[i] = __atomic_load_n(&head->peak_live, __ATOMIC_RELAXED);
+        stats->initialized[i] = MIN(__atomic_load_n(&head->num_initialized, __ATOMIC_RELAXED), pool->num_blocks);
+        stats->spills_in[i] = __atomic_load_n(&head->spills_in, __ATOMIC_RELAXED);
+        stats->failures[i] = __atomic_load_n(&head->failures, __ATOMIC_RELAXED);
+    }
+    stats->oversized = __atomic_load_n(&allocator->oversized, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+// ============ TRACING ===============
+
+bool pool_enable_trace(size_t capacity, const char* failure_path)
+{
+    return pool_allocator_enable_trace(&g_default_allocator, capacity, failure_path);
+}
+
+bool pool_dump_trace(const char* path)
+{
+    return pool_allocator_dump_trace(&g_default_allocator, path);
+}
+
+bool pool_allocator_enable_trace(pool_allocator_t* allocator, size_t capacity, const char* failure_path)
+{
+    if (allocator == NULL || !allocator->initialized || allocator->trace != NULL || capacity == 0 ||
+        capacity > ((size_t)1 << 32))
+    {
+        return false;
+    }
+
+    struct pool_trace_data* trace = calloc(1, sizeof(*trace));
+    if (trace == NULL)
+    {
+        return false;
+    }
+
+    // Round the ring up to a power of two, so a slot is found with a mask
+    size_t rounded = 1;
+    while (rounded < capacity)
+    {
+        rounded <<= 1;
+    }
+
+    trace->mask = rounded - 1;
+    if (posix_memalign((void**)&trace->events, CACHE_LINE_SIZE, rounded * sizeof(pool_trace_event_t)) != 0 ||
+        (failure_path != NULL && (trace->failure_path = strdup(failure_path)) == NULL))
+    {
+        free(trace->events);
+        free(trace);
+        return false;
+    }
+
+    trace->start_ticks = trace_ticks();
+    clock_gettime(CLOCK_MONOTONIC, &trace->start_time);
+    __atomic_store_n(&allocator->trace, trace, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool pool_allocator_dump_trace(pool_allocator_t* allocator, const char* path)
+{
+    if (allocator == NULL || allocator->trace == NULL || path == NULL)
+    {
+        return false;
+    }
+
+    struct pool_trace_data* trace = allocator->trace;
+    uint64_t next = __atomic_load_n(&trace->next, __ATOMIC_RELAXED);
+    uint64_t capacity = trace->mask + 1;
+
+    pool_trace_header_t header = {
+        .magic = POOL_TRACE_MAGIC,
+        .version = POOL_TRACE_VERSION,
+        .event_size = sizeof(pool_trace_event_t),
+        .num_pools = (uint32_t)allocator->num_pools,
+        .ticks_per_second = trace_ticks_per_second(allocator),
+        .num_events = MIN(next, capacity),
+        .dropped_events = next - MIN(next, capacity),
+    };
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        header.block_sizes[i] = get_pool(allocator, i)->block_size;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    // Oldest event first. The ring wraps at most once, so that's at most two writes.
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint64_t i = header.dropped_events; written && i < next;)
+    {
+        uint64_t slot = i & trace->mask;
+        uint64_t run = MIN(next - i, capacity - slot);
+        written = fwrite(&trace->events[slot], sizeof(pool_trace_event_t), run, file) == run;
+        i += run;
+    }
+
+    return fclose(file) == 0 && written;
+}
+
+// ============= HELPER FUNCTIONS =============
+
+static inline void release_block(pool_allocator_t* allocator, pool_header_t* pool, void* ptr)
+{
+    if (recording(allocator))
+    {
+        record_free(allocator, pool, ptr);
+    }
+
+    if (allocator->owned && !pthread_equal(pthread_self(), allocator->owner))
+    {
+        // Leave the block for the owner to reclaim, rather than touching its pools
+        push_remote_free(allocator, ptr);
+        return;
+    }
+
+    if (allocator->thread_cache)
+    {
+        thread_cache_free(allocator, pool, ptr);
+        return;
+    }
+
+    push_free_block(allocator, pool, ptr);
+}
+
+static void* shared_alloc(pool_allocator_t* allocator, size_t n, pool_header_t** from, bool* fresh)
+{
+    *from = NULL;
+    while (true)
+    {
+        // Find the corresponding pool to allocate memory
+        pool_header_t* pool = find_pool_from_size(allocator, n);
+
+        // Missing the best fitting pool is the owner's cue to reclaim blocks freed by other threads,
+        // and with spans, the fitting pool's cue to take another span rather than spill
+        int pool_index = pool == NULL ? allocator->num_pools : get_pool_index(allocator, pool);
+        if ((pool_index > 0 && get_pool(allocator, pool_index - 1)->block_size >= n) &&
+            (drain_on_miss(allocator) || grow_fitting_pool(allocator, n) || split_block(allocator, pool, n)))
+        {
+            continue;
+        }
+
+        if (pool == NULL)
+        {
+            if (POOL_STATS)
+            {
+                stats_failure(allocator, find_size_class(allocator, n), 1);
+            }
+            return NULL;
+        }
+
+        block_header_t* free_block = pop_free_block(allocator, pool, fresh);
+        if (free_block != NULL)
+        {
+            if (POOL_STATS && pool_index > 0 && get_pool(allocator, pool_index - 1)->block_size >= n)
+            {
+                stats_count(&pool->head->spills_in, 1);
+            }
+            *from = pool;
+            return (void*)free_block;
+        }
+
+        // Another thread took the last free block in the meantime (or the pool's bit was stale), so look again
+    }
+}
+
+static size_t shared_alloc_bulk(pool_allocator_t* allocator, size_t n, size_t count, void** out_ptrs)
+{
+    size_t allocated = 0;
+    while (allocated < count)
+    {
+        // Resolve the pool once per batch rather than once per block
+        pool_header_t* pool = find_pool_from_size(allocator, n);
+
+        int pool_index = pool == NULL ? allocator->num_pools : get_pool_index(allocator, pool);
+        if ((pool_index > 0 && get_pool(allocator, pool_index - 1)->block_size >= n) &&
+            (drain_on_miss(allocator) || grow_fitting_pool(allocator, n) || split_block(allocator, pool, n)))
+        {
+            continue;
+        }
+
+        if (pool == NULL)
+        {
+            if (POOL_STATS)
+            {
+                stats_failure(allocator, find_size_class(allocator, n), count - allocated);
+            }
+            break;
+        }
+
+        // Takes whatever the pool has left, spilling the rest over to the next pool on the next pass
+        size_t popped = pop_free_blocks(allocator, pool, count - allocated, out_ptrs + allocated);
+        if (POOL_STATS && pool_index > 0 && get_pool(allocator, pool_index - 1)->block_size >= n)
+        {
+            stats_count(&pool->head->spills_in, popped);
+        }
+
+        // Only this batch is known to have come from this pool, so it's recorded right away
+        for (size_t i = 0; recording(allocator) && i < popped; i++)
+        {
+            record_alloc(allocator, pool, n, out_ptrs[allocated + i]);
+        }
+        allocated += popped;
+    }
+
+    return allocated;
+}
+
+static size_t pop_free_blocks(pool_allocator_t* allocator, pool_header_t* pool, size_t count, void** out_ptrs)
+{
+    // Detach as much of the free list as we need with a single head update
+    size_t popped = 0;
+    block_header_t* bptr = free_list_pop_chain(allocator, pool, count, &popped);
+    for (size_t i = 0; i < popped; i++)
+    {
+        out_ptrs[i] = bptr;
+        bptr = bptr->next;
+    }
+
+    // Carve the rest straight out of the uninitialized region, without linking them through the free list
+    while (LAZY_INIT && popped < count)
+    {
+        byte_ptr_t first;
+        size_t claimed = claim_fresh_blocks(pool, count - popped, &first);
+        if (claimed == 0)
+        {
+            break;
+        }
+
+        size_t aligned_block_size = pool->stride;
+        for (size_t i = 0; i < claimed; i++)
+        {
+            out_ptrs[popped++] = first + i * aligned_block_size;
+        }
+    }
+
+    for (size_t i = 0, run = 0; allocator->spans != NULL && i < popped; i = run)
+    {
+        while (run < popped && get_span(allocator, out_ptrs[run]) == get_span(allocator, out_ptrs[i]))
+        {
+            run++;
+        }
+        count_span_block(allocator, out_ptrs[i], (int32_t)(run - i));
+    }
+
+    if (POOL_STATS && popped != 0)
+    {
+        stats_alloc(pool, popped);
+    }
+
+    if (FREE_POOL_MASK && !pool_has_free(pool))
+    {
+        mark_pool_empty(allocator, pool);
+    }
+
+    return popped;
+}
+
+static inline block_header_t* pop_free_block(pool_allocator_t* allocator, pool_header_t* pool, bool* fresh)
+{
+    // Pop off an available free block in O(1) time
+    block_header_t* free_block = free_list_pop(pool);
+
+    // Otherwise bump the pool's frontier past its next never-allocated block, which is handed out without being written
+    if (LAZY_INIT && free_block == NULL && allocator->spans == NULL)
+    {
+        byte_ptr_t block;
+        if (claim_fresh_blocks(pool, 1, &block) != 0)
+        {
+            free_block = (block_header_t*)block;
+            if (fresh != NULL)
+            {
+                *fresh = true;
+            }
+        }
+    }
+
+    // Carve a span pool a new span once its free list runs dry
+    while (free_block == NULL && grow_pool(allocator, pool))
+    {
+        free_block = free_list_pop(pool);
+    }
+
+    if (allocator->spans != NULL && free_block != NULL)
+    {
+        count_span_block(allocator, free_block, 1);
+    }
+
+    if (POOL_STATS && free_block != NULL)
+    {
+        stats_alloc(pool, 1);
+    }
+
+    // Flag the pool as exhausted as soon as it runs dry so later searches skip it
+    if (FREE_POOL_MASK && !pool_has_free(pool))
+    {
+        mark_pool_empty(allocator, pool);
+    }
+
+    return free_block;
+}
+
+static inline void push_free_block(pool_allocator_t* allocator, pool_header_t* pool, void* ptr)
+{
+    push_free_chain(allocator, pool, ptr, ptr, 1);
+}
+
+static inline void push_free_chain(pool_allocator_t* allocator, pool_header_t* pool, block_header_t* first,
+                                   block_header_t* last, size_t count)
+{
+    if (allocator->spans != NULL)
+    {
+        count_span_chain(allocator, first, last, -1);
+    }
+
+    if (POOL_STATS)
+    {
+        stats_count(&pool->head->frees, count);
+    }
+
+    // Only the push that takes a free list from empty to non-empty can find the pool's bit cleared
+    if (free_list_push(pool, first, last) && FREE_POOL_MASK)
+    {
+        mark_pool_free(allocator, pool);
+    }
+}
+
+static inline void group_free_block(pool_allocator_t* allocator, pool_header_t* pool, block_header_t* bptr,
+                                    block_header_t** firsts, block_header_t** lasts, size_t* counts)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    // Atomic like free_list_push(), since concurrent bulk pops may still speculatively read the link
+    int i = get_pool_index(allocator, pool);
+    if (firsts[i] == NULL)
+    {
+        lasts[i] = bptr;
+        counts[i] = 0;
+    }
+    __atomic_store_n(&bptr->next, firsts[i], __ATOMIC_RELAXED);
+    firsts[i] = bptr;
+    counts[i]++;
+}
+
+static inline void push_free_groups(pool_allocator_t* allocator, block_header_t** firsts, block_header_t** lasts,
+                                    size_t* counts)
+{
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        if (firsts[i] != NULL)
+        {
+            push_free_chain(allocator, get_pool(allocator, i), firsts[i], lasts[i], counts[i]);
+        }
+    }
+}
+
+static inline void mark_pool_free(pool_allocator_t* allocator, pool_header_t* pool)
+{
+    // Order the push before reading the mask, pairing with the re-check in mark_pool_empty()
+    uint64_t bit = UINT64_C(1) << get_pool_index(allocator, pool);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!(__atomic_load_n(&allocator->free_pools, __ATOMIC_RELAXED) & bit))
+    {
+        __atomic_fetch_or(&allocator->free_pools, bit, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void mark_pool_empty(pool_allocator_t* allocator, pool_header_t* pool)
+{
+    uint64_t bit = UINT64_C(1) << get_pool_index(allocator, pool);
+    if (!(__atomic_load_n(&allocator->free_pools, __ATOMIC_RELAXED) & bit))
+    {
+        return;
+    }
+
+    __atomic_fetch_and(&allocator->free_pools, ~bit, __ATOMIC_RELAXED);
+
+    // A block freed between our emptiness check and the clear may have seen the bit still set
+    // and skipped setting it, so look again now that the bit is visibly clear.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (pool_has_free(pool))
+    {
+        __atomic_fetch_or(&allocator->free_pools, bit, __ATOMIC_RELAXED);
+    }
+}
+
+static inline bool pool_has_free(pool_header_t* pool)
+{
+    return free_list_head(pool) != NULL ||
+           __atomic_load_n(&pool->head->num_initialized, __ATOMIC_RELAXED) < pool->num_blocks;
+}
+
+static inline block_header_t* free_list_head(pool_header_t* pool)
+{
+    return (block_header_t*)(uintptr_t)(__atomic_load_n(&pool->head->next_free, __ATOMIC_RELAXED) & TAG_PTR_MASK);
+}
+
+static inline block_header_t* free_list_pop(pool_header_t* pool)
+{
+    if (!LOCK_FREE)
+    {
+        block_header_t* free_block = (block_header_t*)(uintptr_t)pool->head->next_free;
+        if (free_block != NULL)
+        {
+            pool->head->next_free = (uintptr_t)free_block->next;
+        }
+
+        return free_block;
+    }
+
+    uint64_t head = __atomic_load_n(&pool->head->next_free, __ATOMIC_ACQUIRE);
+    while (true)
+    {
+        block_header_t* free_block = (block_header_t*)(uintptr_t)(head & TAG_PTR_MASK);
+        if (free_block == NULL)
+        {
+            return NULL;
+        }
+
+        // The block may be popped (and written to) by another thread before our CAS,
+        // in which case the head's tag has moved on and the stale next pointer is discarded.
+        block_header_t* next = __atomic_load_n(&free_block->next, __ATOMIC_RELAXED);
+        uint64_t new_head = ((head & ~TAG_PTR_MASK) + (UINT64_C(1) << TAG_SHIFT)) | (uintptr_t)next;
+        if (__atomic_compare_exchange_n(&pool->head->next_free, &head, new_head, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            return free_block;
+        }
+    }
+}
+
+static inline block_header_t* free_list_pop_chain(pool_allocator_t* allocator, pool_header_t* pool, size_t max,
+                                                  size_t* count)
+{
+    *count = 0;
+    if (max == 0)
+    {
+        return NULL;
+    }
+
+    if (!LOCK_FREE)
+    {
+        block_header_t* first = (block_header_t*)(uintptr_t)pool->head->next_free;
+        block_header_t* bptr = first;
+        while (bptr != NULL && *count < max)
+        {
+            bptr = bptr->next;
+            *count += 1;
+        }
+
+        pool->head->next_free = (uintptr_t)bptr;
+        return first;
+    }
+
+    uint64_t head = __atomic_load_n(&pool->head->next_free, __ATOMIC_ACQUIRE);
+    while (true)
+    {
+        block_header_t* first = (block_header_t*)(uintptr_t)(head & TAG_PTR_MASK);
+        if (first == NULL)
+        {
+            return NULL;
+        }
+
+        // Walk up to max blocks. Blocks may be popped and overwritten by another thread under us, in which
+        // case the CAS fails on the moved tag; until then, only follow links that stay inside the heap.
+        size_t walked = 1;
+        block_header_t* next = __atomic_load_n(&first->next, __ATOMIC_RELAXED);
+        while (walked < max && next != NULL)
+        {
+            if (!heap_contains(allocator, next))
+            {
+                break;
+            }
+
+            next = __atomic_load_n(&next->next, __ATOMIC_RELAXED);
+            walked++;
+        }
+
+        uint64_t new_head = ((head & ~TAG_PTR_MASK) + (UINT64_C(1) << TAG_SHIFT)) | (uintptr_t)next;
+        if ((next == NULL || heap_contains(allocator, next)) &&
+            __atomic_compare_exchange_n(&pool->head->next_free, &head, new_head, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            *count = walked;
+            return first;
+        }
+
+        // Lost a race (or read a stale link), so start over from the current head
+        head = __atomic_load_n(&pool->head->next_free, __ATOMIC_ACQUIRE);
+    }
+}
+
+static inline block_header_t* free_list_detach(pool_header_t* pool)
+{
+    if (!LOCK_FREE)
+    {
+        block_header_t* first = (block_header_t*)(uintptr_t)pool->head->next_free;
+        pool->head->next_free = 0;
+        return first;
+    }
+
+    // Swap in an empty list with the tag bumped, so that poppers holding the old head fail their CAS.
+    // Nothing is dereferenced, so other threads overwriting popped blocks can't lead us astray.
+    uint64_t head = __atomic_load_n(&pool->head->next_free, __ATOMIC_RELAXED);
+    uint64_t empty;
+    do
+    {
+        if ((head & TAG_PTR_MASK) == 0)
+        {
+            return NULL;
+        }
+
+        empty = (head & ~TAG_PTR_MASK) + (UINT64_C(1) << TAG_SHIFT);
+    } while (!__atomic_compare_exchange_n(&pool->head->next_free, &head, empty, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    return (block_header_t*)(uintptr_t)(head & TAG_PTR_MASK);
+}
+
+static inline bool free_list_push(pool_header_t* pool, block_header_t* first, block_header_t* last)
+{
+    if (!LOCK_FREE)
+    {
+        bool was_empty = pool->head->next_free == 0;
+        last->next = (block_header_t*)(uintptr_t)pool->head->next_free;
+        pool->head->next_free = (uintptr_t)first;
+        return was_empty;
+    }
+
+    uint64_t head = __atomic_load_n(&pool->head->next_free, __ATOMIC_RELAXED);
+    uint64_t new_head;
+    do
+    {
+        __atomic_store_n(&last->next, (block_header_t*)(uintptr_t)(head & TAG_PTR_MASK), __ATOMIC_RELAXED);
+        new_head = ((head & ~TAG_PTR_MASK) + (UINT64_C(1) << TAG_SHIFT)) | (uintptr_t)first;
+    } while (!__atomic_compare_exchange_n(&pool->head->next_free, &head, new_head, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return (head & TAG_PTR_MASK) == 0;
+}
+
+static inline void shared_lock(pool_allocator_t* allocator)
+{
+    if (!LOCK_FREE)
+    {
+        pthread_mutex_lock(&allocator->lock);
+    }
+}
+
+static inline void shared_unlock(pool_allocator_t* allocator)
+{
+    if (!LOCK_FREE)
+    {
+        pthread_mutex_unlock(&allocator->lock);
+    }
+}
+
+static inline pool_thread_cache_t* get_thread_cache(pool_allocator_t* allocator)
+{
+    pool_thread_cache_t* cache = pthread_getspecific(allocator->cache_key);
+    if (cache == NULL)
+    {
+        cache = calloc(1, sizeof(pool_thread_cache_t));
+        if (cache == NULL)
+        {
+            return NULL;
+        }
+
+        cache->allocator = allocator;
+        if (pthread_setspecific(allocator->cache_key, cache) != 0)
+        {
+            free(cache);
+            return NULL;
+        }
+    }
+
+    return cache;
+}
+
+static bool refill_thread_cache(pool_allocator_t* allocator, pool_thread_cache_t* cache, int class_index)
+{
+    size_t batch = (allocator->cache_capacity[class_index] + 1) / 2;
+    if (batch == 0)
+    {
+        return false;
+    }
+
+    pool_header_t* pool = get_pool(allocator, class_index);
+    size_t count = 0;
+    block_header_t* first = NULL;
+
+    // Detach up to a batch of blocks from the shared free list with a single head update,
+    // carving a span pool a new span if its list has run dry
+    shared_lock(allocator);
+    do
+    {
+        first = free_list_pop_chain(allocator, pool, batch, &count);
+    } while (count == 0 && grow_pool(allocator, pool));
+
+    block_header_t* last = first;
+    for (size_t i = 1; i < count; i++)
+    {
+        last = last->next;
+    }
+
+    // Top the batch up with never-allocated blocks, which need linking for the magazine
+    while (LAZY_INIT && count < batch)
+    {
+        byte_ptr_t fresh;
+        size_t claimed = claim_fresh_blocks(pool, batch - count, &fresh);
+        if (claimed == 0)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < claimed; i++)
+        {
+            block_header_t* block = (block_header_t*)(fresh + i * pool->stride);
+            if (last == NULL)
+            {
+                first = block;
+            }
+            else
+            {
+                last->next = block;
+            }
+            last = block;
+        }
+        count += claimed;
+    }
+
+    if (allocator->spans != NULL && count != 0)
+    {
+        count_span_chain(allocator, first, last, 1);
+    }
+
+    if (POOL_STATS && count != 0)
+    {
+        stats_alloc(pool, count);
+    }
+
+    if (FREE_POOL_MASK && !pool_has_free(pool))
+    {
+        mark_pool_empty(allocator, pool);
+    }
+    shared_unlock(allocator);
+
+    if (count == 0)
+    {
+        return false;
+    }
+
+    last->next = cache->bins[class_index].head;
+    cache->bins[class_index].head = first;
+    cache->bins[class_index].count += count;
+
+    return true;
+}
+
+static void flush_thread_cache(pool_allocator_t* allocator, pool_thread_cache_t* cache, int class_index, size_t keep)
+{
+    size_t count = cache->bins[class_index].count;
+    if (count <= keep)
+    {
+        return;
+    }
+
+    // Keep the most recently freed blocks and detach the rest of the magazine
+    block_header_t* kept_tail = NULL;
+    block_header_t* first = cache->bins[class_index].head;
+    for (size_t i = 0; i < keep; i++)
+    {
+        kept_tail = first;
+        first = first->next;
+    }
+
+    block_header_t* last = first;
+    while (last->next != NULL)
+    {
+        last = last->next;
+    }
+
+    if (kept_tail == NULL)
+    {
+        cache->bins[class_index].head = NULL;
+    }
+    else
+    {
+        kept_tail->next = NULL;
+    }
+    cache->bins[class_index].count = keep;
+
+    // Splice the detached chain onto the shared free list with a single head update
+    pool_header_t* pool = get_pool(allocator, class_index);
+    shared_lock(allocator);
+    push_free_chain(allocator, pool, first, last, count - keep);
+    shared_unlock(allocator);
+}
+
+static void destroy_thread_cache(void* ptr)
+{
+    pool_thread_cache_t* cache = ptr;
+    pool_allocator_t* allocator = cache->allocator;
+
+    // Hand every cached block back to the shared pools when the thread exits
+    for (int i = 0; i < allocator->num_pools; i++)
+    {
+        flush_thread_cache(allocator, cache, i, 0);
+    }
+
+    free(cache);
+}
+
+static bool attach_heap(pool_allocator_t* allocator, void* heap, size_t heap_size)
+{
+    if (heap_size == 0)
+    {
+        return false;
+    }
 
-static uint8_t* base_addr;
-static uint8_t* end_addr;
-static int num_pools;
-static int pool_size;
-static int byte_align;
-static bool initialized = false;
-static pool_header_t* last_used_pool;
+    if (heap == NULL)
+    {
+        // Anonymous mappings are zeroed and only committed as pages are touched,
+        // so large heaps cost nothing up front under lazy initialization.
+        heap = mmap(NULL, heap_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (heap == MAP_FAILED)
+        {
+            return false;
+        }
 
-// ============ TUNABLE BLOCK POOL ALLOCATOR ===============
+        allocator->owns_heap = true;
+        allocator->zeroed_heap = true;
+    }
+    else
+    {
+        // Caller-provided buffers may be arbitrarily aligned
+        size_t padding = aligned((uintptr_t)heap, byte_align) - (uintptr_t)heap;
+        if (heap_size <= padding)
+        {
+            return false;
+        }
 
-bool pool_init(const size_t* block_sizes, size_t block_size_count)
+        heap = (byte_ptr_t)heap + padding;
+        heap_size -= padding;
+        allocator->owns_heap = false;
+        allocator->zeroed_heap = false;
+    }
+
+    allocator->heap = heap;
+    allocator->heap_size = heap_size;
+
+    return true;
+}
+
+static void release_heap(pool_allocator_t* allocator)
 {
-    // Make sure we have a valid number of block sizes
-    if (initialized ||
-        block_sizes == NULL || block_size_count <= 0 || block_size_count > MAX_NUM_POOLS)
+    if (allocator->owns_heap)
     {
-        return false;
+        munmap(allocator->heap, allocator->heap_size);
     }
 
-    // Initialize static global variables
-    byte_align = sizeof(void*);
-    num_pools = (int)block_size_count;
-    pool_size = align((sizeof(g_pool_heap) / num_pools) - sizeof(pool_header_t));
-    base_addr = g_pool_heap + (num_pools * sizeof(pool_header_t));
-    end_addr = g_pool_heap + HEAP_SIZE_BYTES;
+    allocator->heap = NULL;
+    allocator->heap_size = 0;
+    allocator->owns_heap = false;
+}
 
-    // Populate the heap with pool headers and pools of free blocks
-    size_t last_block_size = 0;
-    for (int i = 0; i < num_pools; i++)
+static bool plan_layout(pool_allocator_t* allocator, const pool_config_t* config)
+{
+    size_t num_pools = allocator->num_pools;
+    allocator->layout = config->layout;
+    allocator->spans = NULL;
+
+    allocator->trailing_used = 0;
+    allocator->trailing_blocks = NULL;
+
+    // Block sizes are rounded up to their class's alignment, so aligning a class's first block aligns them all
+    allocator->max_alignment = byte_align;
+    for (size_t i = 0; i < num_pools; i++)
     {
-        size_t block_size = block_sizes[i];
-        if (block_size <= last_block_size || block_size == 0 ||
-            align(block_size) > pool_size)
+        size_t alignment = config->alignments == NULL ? 0 : config->alignments[i];
+        alignment = MAX(alignment, (size_t)byte_align);
+        if (alignment & (alignment - 1))
         {
             return false;
         }
 
-        // Create a pool header for this block size
-        // and point it to the pool's first free block
-        pool_header_t* pool = create_pool_header(block_size, i);
-        if (pool == NULL)
+        allocator->alignments[i] = alignment;
+        allocator->class_sizes[i] = config->block_sizes[i];
+        if (alignment > (size_t)byte_align)
+        {
+            allocator->class_sizes[i] = aligned(config->block_sizes[i], alignment);
+        }
+        allocator->max_alignment = MAX(allocator->max_alignment, alignment);
+    }
+
+    // Spans already reuse their tails whenever they change pools
+    allocator->fill_slack = config->fill_slack;
+    if (config->fill_slack && config->layout == POOL_LAYOUT_SPANS)
+    {
+        return false;
+    }
+
+    // An even split only lines up with the default alignment, so aligned pools are placed one by one instead
+    bool aligned_even = config->layout == POOL_LAYOUT_EVEN && allocator->max_alignment > (size_t)byte_align;
+    if (config->capacity != POOL_CAPACITY_EVEN || config->layout == POOL_LAYOUT_COMPACT || aligned_even)
+    {
+        // Individually sized or packed pools need their headers in front and a prefix-offset table for lookups
+        if ((config->layout != POOL_LAYOUT_EVEN && config->layout != POOL_LAYOUT_COMPACT) ||
+            (config->capacity != POOL_CAPACITY_EVEN && config->capacities == NULL) ||
+            allocator->heap_size <= num_pools * sizeof(pool_header_t))
         {
             return false;
         }
 
-        if (!LAZY_INIT)
+        allocator->pools = (pool_header_t*)allocator->heap;
+        allocator->pool_size = 0;
+        allocator->pool_shift = 0;
+        allocator->base_addr = allocator->heap + (num_pools * sizeof(pool_header_t));
+
+        return plan_capacities(allocator, config, allocator->heap_size - num_pools * sizeof(pool_header_t));
+    }
+
+    if (config->layout == POOL_LAYOUT_POW2)
+    {
+        // Largest power of two span for which every pool fits once the first one is aligned to it
+        size_t span = allocator->heap_size / num_pools;
+        while (span & (span - 1))
         {
-            // Populate every free block in the pool with a block header
-            // (which get overwritten on allocation)
-            populate_block_headers(pool);
+            span &= span - 1;
         }
 
-        last_block_size = block_size;
+        for (; span >= allocator->max_alignment; span >>= 1)
+        {
+            byte_ptr_t base = (byte_ptr_t)aligned((uintptr_t)allocator->heap, span);
+            if ((size_t)(base - allocator->heap) + num_pools * span <= allocator->heap_size)
+            {
+                allocator->pools = allocator->headers;
+                allocator->pool_size = span;
+                allocator->pool_shift = __builtin_ctzll(span);
+                allocator->base_addr = base;
+                allocator->end_addr = base + num_pools * span;
+                return true;
+            }
+        }
+
+        return false;
+    }
+    else if (config->layout == POOL_LAYOUT_SPANS)
+    {
+        return allocator->max_alignment <= SPAN_SIZE_BYTES && plan_spans(allocator);
+    }
+    else if (config->layout != POOL_LAYOUT_EVEN)
+    {
+        return false;
+    }
+
+    // Make sure every pool has room for its header
+    if (allocator->heap_size / num_pools <= sizeof(pool_header_t))
+    {
+        return false;
     }
 
-    last_used_pool = get_pool(0);
-    initialized = true;
+    allocator->pools = (pool_header_t*)allocator->heap;
+    allocator->pool_size = align((allocator->heap_size / num_pools) - sizeof(pool_header_t));
+    allocator->pool_reciprocal = plan_reciprocal(allocator, allocator->pool_size);
+    allocator->pool_shift = 0;
+    allocator->base_addr = allocator->heap + (num_pools * sizeof(pool_header_t));
+    allocator->end_addr = allocator->heap + allocator->heap_size;
 
     return true;
 }
 
-void* pool_alloc(size_t n)
+static bool plan_spans(pool_allocator_t* allocator)
 {
-    if (!initialized || n == 0)
+    span_header_t* table;
+    byte_ptr_t base;
+    size_t num_spans = plan_span_table(allocator->heap, allocator->heap_size, &table, &base);
+    if (num_spans == 0)
     {
-        return NULL;
+        return false;
     }
 
-    // Find the corresponding pool to allocate memory
-    pool_header_t* pool = find_pool_from_size(n);
-    if (pool == NULL)
+    allocator->pools = allocator->headers;
+    allocator->pool_size = 0;
+    allocator->pool_shift = 0;
+    allocator->base_addr = base;
+    allocator->end_addr = base + num_spans * SPAN_SIZE_BYTES;
+    allocator->spans = table;
+    allocator->num_spans = num_spans;
+    allocator->fresh_spans = 0;
+    allocator->empty_spans = 0;
+    allocator->reclaiming = false;
+    allocator->span_pool.head = &allocator->span_head;
+    allocator->span_head.next_free = 0;
+
+    return true;
+}
+
+static size_t plan_span_table(byte_ptr_t start, size_t size, span_header_t** table, byte_ptr_t* base)
+{
+    // The span table goes first, then as many aligned spans as still fit behind it
+    byte_ptr_t spans = (byte_ptr_t)aligned((uintptr_t)start, sizeof(span_header_t));
+    size_t available = size - MIN((size_t)(spans - start), size);
+    size_t num_spans = available / (SPAN_SIZE_BYTES + sizeof(span_header_t));
+    for (; num_spans > 0; num_spans--)
     {
-        return NULL;
+        *base = (byte_ptr_t)aligned((uintptr_t)spans + num_spans * sizeof(span_header_t), SPAN_SIZE_BYTES);
+        if ((size_t)(*base - start) + num_spans * SPAN_SIZE_BYTES <= size)
+        {
+            break;
+        }
     }
 
-    if (LAZY_INIT)
+    // Only the table is touched up front, spans are handed out (and their pages committed) on demand
+    *table = (span_header_t*)spans;
+    for (size_t i = 0; i < num_spans; i++)
     {
-        // Lazily initialize any remaining block headers in this pool
-        lazy_populate_block_header(pool);
+        (*table)[i] = (span_header_t){.live = 0, .class_index = -1, .free_count = 0};
     }
 
-    // Pop off an available free block in O(1) time
-    block_header_t* free_block = pool->next_free;
-
-    // Update the pool's free block
-    pool->next_free = free_block->next;
-
-    return (void*)free_block;
+    return num_spans;
 }
 
-void pool_free(void* ptr)
+static bool plan_capacities(pool_allocator_t* allocator, const pool_config_t* config, size_t available)
 {
-    if (!initialized)
+    int num_pools = allocator->num_pools;
+    size_t total_weight = 0;
+    for (int i = 0; i < num_pools && config->capacity == POOL_CAPACITY_WEIGHTS; i++)
     {
-        return;
+        total_weight += config->capacities[i];
     }
 
-    pool_header_t* pool = find_pool_from_pointer(ptr);
-    if (pool == NULL)
+    // Shares leave room for the gaps aligning each pool's first block may take
+    size_t reserve = 0;
+    for (int i = 0; i < num_pools; i++)
     {
-        return;
+        reserve += allocator->alignments[i] - byte_align;
     }
 
-    block_header_t* bptr = ptr;
-    bptr->next = pool->next_free;
-    pool->next_free = bptr;
-}
+    if (reserve >= available)
+    {
+        return false;
+    }
 
-// ============= HELPER FUNCTIONS =============
+    size_t shares = available - reserve;
+    size_t offset = 0;
+    for (int i = 0; i < num_pools; i++)
+    {
+        size_t capacity = config->capacities == NULL ? 0 : config->capacities[i];
+        size_t block_size = align(allocator->class_sizes[i]);
+        size_t bytes;
+        if (block_size == 0)
+        {
+            return false;
+        }
+
+        switch (config->capacity)
+        {
+        case POOL_CAPACITY_EVEN:
+            bytes = shares / num_pools;
+            break;
+        case POOL_CAPACITY_WEIGHTS:
+            bytes = total_weight == 0 ? 0 : (size_t)((double)shares * capacity / total_weight);
+            break;
+        case POOL_CAPACITY_BYTES:
+            bytes = capacity;
+            break;
+        case POOL_CAPACITY_BLOCKS:
+            bytes = capacity > SIZE_MAX / block_size ? SIZE_MAX : capacity * block_size;
+            break;
+        default:
+            return false;
+        }
+
+        // Keep every pool aligned, and the pools within the heap. Packed pools end right after their last block.
+        bytes &= ~(size_t)(byte_align - 1);
+        bytes -= config->layout == POOL_LAYOUT_COMPACT ? bytes % block_size : 0;
+        size_t start = (size_t)aligned((uintptr_t)allocator->base_addr + offset, allocator->alignments[i]) -
+                       (uintptr_t)allocator->base_addr;
+        if (start > available || bytes > available - start)
+        {
+            return false;
+        }
+
+        allocator->pool_offsets[i] = start;
+        offset = start + bytes;
+    }
+
+    allocator->pool_offsets[num_pools] = offset;
+    allocator->end_addr = allocator->base_addr + offset;
+
+    return true;
+}
 
-static inline pool_header_t* create_pool_header(size_t block_size, int i)
+static inline pool_header_t* create_pool_header(pool_allocator_t* allocator, size_t block_size, int i)
 {
-    pool_header_t* pool = get_pool(i);
+    pool_header_t* pool = get_pool(allocator, i);
     pool->block_size = block_size;
-    pool->num_initialized = 1;
+    pool->stride = align(block_size);
+    pool->reciprocal = plan_reciprocal(allocator, pool->stride);
+    pool->head = &allocator->heads[i];
+    pool->head->num_initialized = 0;
+    pool->head->next_free = 0;
+
+    if (allocator->spans != NULL)
+    {
+        // Blocks come from spans as the pool needs them, so there's nothing to reserve up front
+        pool->num_blocks = 0;
+        pool->first_block = NULL;
+        return pool->stride <= SPAN_SIZE_BYTES ? pool : NULL;
+    }
 
-    byte_ptr_t first_free = base_addr + (i * pool_size);
+    // Account for the final pool not being able to accomodate every block in some cases
+    size_t pool_offset = pool_start_offset(allocator, i);
+    size_t pool_bound = pool_end_offset(allocator, i);
 
     // Check to make sure we can accomodate at least 1 block in this pool.
     // Otherwise return null and fail initialization.
-    if (first_free + align(block_size) > end_addr)
+    if (pool_offset + pool->stride > pool_bound)
     {
         return NULL;
     }
 
-    pool->next_free = (block_header_t*)first_free;
+    pool->num_blocks = (pool_bound - pool_offset) / pool->stride;
+    pool->first_block = allocator->base_addr + pool_offset;
 
     return pool;
 }
 
-static inline void lazy_populate_block_header(pool_header_t* pool)
+static void fill_pool_slack(pool_allocator_t* allocator)
 {
-    size_t aligned_block_size = align(pool->block_size);
-    int pool_offset = get_pool_index(pool) * pool_size;
-
-    // Account for the final pool not being able to accomodate every block in some cases
-    int pool_bound = MIN(HEAP_SIZE_BYTES - num_pools * sizeof(pool_header_t), pool_offset + pool_size);
-    int num_blocks = (pool_bound - pool_offset) / aligned_block_size;
-    if (pool->num_initialized < num_blocks)
+    // The smallest class's own tail is too small for one of its blocks by definition
+    pool_header_t* smallest = get_pool(allocator, 0);
+    size_t piece_size = smallest->stride;
+    allocator->recovered_bytes = 0;
+    for (int i = 0; i < allocator->num_pools; i++)
     {
-        byte_ptr_t pool_base = base_addr + pool_offset;
-        byte_ptr_t to_init_addr = pool_base + aligned_block_size * pool->num_initialized;
-        block_header_t* prev_init = (block_header_t*)(to_init_addr - aligned_block_size);
-        block_header_t* to_init = (block_header_t*)to_init_addr;
-        prev_init->next = to_init;
+        pool_header_t* pool = get_pool(allocator, i);
+        size_t start = pool_start_offset(allocator, i) + pool->num_blocks * pool->stride;
+        byte_ptr_t first = (byte_ptr_t)aligned((uintptr_t)allocator->base_addr + start, allocator->alignments[0]);
+        byte_ptr_t end = allocator->base_addr + pool_end_offset(allocator, i);
+        size_t count = first < end ? (size_t)(end - first) / piece_size : 0;
+        allocator->slack_offsets[i] = start;
+        if (count == 0)
+        {
+            continue;
+        }
+
+        allocator->recovered_bytes += count * piece_size;
+        byte_ptr_t last = first + (count - 1) * piece_size;
+        for (byte_ptr_t bptr = first; bptr < last; bptr += piece_size)
+        {
+            ((block_header_t*)bptr)->next = (block_header_t*)(bptr + piece_size);
+        }
 
-        pool->num_initialized += 1;
+        free_list_push(smallest, (block_header_t*)first, (block_header_t*)last);
     }
 }
 
-static inline void populate_block_headers(pool_header_t* pool)
+static inline size_t claim_fresh_blocks(pool_header_t* pool, size_t max, byte_ptr_t* first)
 {
-    size_t aligned_block_size = align(pool->block_size);
-    byte_ptr_t first_free = (byte_ptr_t)pool->next_free;
-
-    block_header_t* last = NULL;
-    for (size_t offset = 0;
-         offset + aligned_block_size <= pool_size;
-         offset += aligned_block_size)
+    // Claim the next run of uninitialized blocks, racing any other threads doing the same
+    size_t first_index = __atomic_load_n(&pool->head->num_initialized, __ATOMIC_RELAXED);
+    size_t count;
+    do
     {
-        // Check to make sure we're not overflowing by allocating
-        // memory outside the heap.
-        if (first_free + offset + aligned_block_size > end_addr)
+        if (first_index >= pool->num_blocks)
         {
-            break;
+            return 0;
         }
 
-        block_header_t* bptr = (block_header_t*)(first_free + offset);
-        if (last != NULL)
-        {
-            last->next = bptr;
-        }
-        last = bptr;
+        count = MIN(max, pool->num_blocks - first_index);
+    } while (!__atomic_compare_exchange_n(&pool->head->num_initialized, &first_index, first_index + count, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    *first = pool->first_block + first_index * pool->stride;
+    return count;
+}
+
+static inline void populate_block_headers(pool_header_t* pool)
+{
+    // Initialize the whole pool as one batch
+    size_t aligned_block_size = pool->stride;
+    byte_ptr_t first = pool->first_block;
+    byte_ptr_t last = first + (pool->num_blocks - 1) * aligned_block_size;
+    for (byte_ptr_t bptr = first; bptr < last; bptr += aligned_block_size)
+    {
+        ((block_header_t*)bptr)->next = (block_header_t*)(bptr + aligned_block_size);
     }
+
+    ((block_header_t*)last)->next = NULL;
+    pool->head->next_free = (uintptr_t)first;
+    pool->head->num_initialized = pool->num_blocks;
 }
 
-static inline pool_header_t* find_pool_from_size(size_t n)
+static inline pool_header_t* find_pool_from_size(pool_allocator_t* allocator, size_t n)
 {
+    int num_pools = allocator->num_pools;
     int start = 0, end = num_pools - 1;
     int middle = (start + end) / 2;
     pool_header_t* pool = NULL;
 
-    // Check cache for last used pool
-    if (POOL_CACHE && n == last_used_pool->block_size)
+    // Look up the fitting size class directly
+    pool_header_t* last_used_pool =
+        POOL_CACHE && !SIZE_CLASS_TABLE ? __atomic_load_n(&allocator->last_used_pool, __ATOMIC_RELAXED) : NULL;
+    if (SIZE_CLASS_TABLE)
+    {
+        middle = find_size_class(allocator, n);
+        if (middle < 0)
+        {
+            return NULL;
+        }
+    }
+    // else check cache for last used pool
+    else if (POOL_CACHE && n == last_used_pool->block_size)
     {
         pool = last_used_pool;
-        middle = get_pool_index(pool);
+        middle = get_pool_index(allocator, pool);
     }
     // else binary search through pool headers
     else if (BINARY_SEARCH)
     {
         while (start <= end)
         {
-            pool = get_pool(middle);
+            pool = get_pool(allocator, middle);
             if (pool->block_size < n)
             {
                 start = middle + 1;
@@ -227,7 +3827,7 @@ static inline pool_header_t* find_pool_from_size(size_t n)
     {
         for (middle = 0; middle < num_pools; middle++)
         {
-            pool = get_pool(middle);
+            pool = get_pool(allocator, middle);
             if (pool->block_size >= n)
             {
                 break;
@@ -236,11 +3836,39 @@ static inline pool_header_t* find_pool_from_size(size_t n)
 
         middle = MIN(middle, num_pools - 1);
     }
-    
+
+
+    // Jump straight to the first pool from here on that may have free space,
+    // unless the fitting pool itself has some (the common case)
+    if (FREE_POOL_MASK)
+    {
+        pool = get_pool(allocator, middle);
+        if (n > pool->block_size)
+        {
+            middle += 1;
+        }
+        else if (pool_has_free(pool))
+        {
+            remember_pool(allocator, pool);
+            return pool;
+        }
+
+        uint64_t candidates = middle < 64 ? __atomic_load_n(&allocator->free_pools, __ATOMIC_RELAXED) &
+                                                (UINT64_MAX << middle)
+                                          : 0;
+        if (candidates == 0)
+        {
+            return NULL;
+        }
+
+        pool = get_pool(allocator, __builtin_ctzll(candidates));
+        remember_pool(allocator, pool);
+        return pool;
+    }
 
     // Check out larger block size pools if the current has no free space
-    pool = get_pool(middle);
-    while (n > pool->block_size || pool->next_free == NULL)
+    pool = get_pool(allocator, middle);
+    while (n > pool->block_size || !pool_has_free(pool))
     {
         middle += 1;
         if (middle == num_pools)
@@ -248,32 +3876,226 @@ static inline pool_header_t* find_pool_from_size(size_t n)
             return NULL;
         }
 
-        pool = get_pool(middle);
+        pool = get_pool(allocator, middle);
     }
 
-    last_used_pool = pool;
+    remember_pool(allocator, pool);
     return pool;
 }
 
-static inline pool_header_t* find_pool_from_pointer(void* ptr)
+static inline void remember_pool(pool_allocator_t* allocator, pool_header_t* pool)
+{
+    // Only the cache lookup reads this back, and every allocating thread writing the instance's
+    // read-mostly line for nothing would bring back the false sharing the padded heads avoid
+    if (POOL_CACHE && !SIZE_CLASS_TABLE)
+    {
+        __atomic_store_n(&allocator->last_used_pool, pool, __ATOMIC_RELAXED);
+    }
+}
+
+static inline int find_size_class(pool_allocator_t* allocator, size_t n)
+{
+    int num_pools = allocator->num_pools;
+    int class_index = -1;
+
+    if (SIZE_CLASS_TABLE)
+    {
+        if (n <= SIZE_CLASS_TABLE_MAX)
+        {
+            // The granule's entry fits its smallest size, so step up past any classes splitting the granule
+            class_index = allocator->size_class_table[(n + (1 << SIZE_CLASS_SHIFT) - 1) >> SIZE_CLASS_SHIFT];
+            while (class_index < num_pools && allocator->class_sizes[class_index] < n)
+            {
+                class_index++;
+            }
+        }
+        else
+        {
+            // Count the classes too small for n without branching on each comparison
+            class_index = allocator->large_class_start;
+            for (int i = allocator->large_class_start; i < num_pools; i++)
+            {
+                class_index += allocator->class_sizes[i] < n;
+            }
+        }
+
+        return class_index < num_pools ? class_index : -1;
+    }
+
+    // Binary search for the smallest block size fitting n bytes
+    int start = 0, end = num_pools - 1;
+    while (start <= end)
+    {
+        int middle = (start + end) / 2;
+        if (get_pool(allocator, middle)->block_size >= n)
+        {
+            class_index = middle;
+            end = middle - 1;
+        }
+        else
+        {
+            start = middle + 1;
+        }
+    }
+
+    return class_index;
+}
+
+static void build_size_class_table(pool_allocator_t* allocator)
+{
+    int class_index = 0;
+    for (size_t granule = 0; granule <= (SIZE_CLASS_TABLE_MAX >> SIZE_CLASS_SHIFT); granule++)
+    {
+        // Smallest request size that maps onto this granule
+        size_t n = granule == 0 ? 0 : ((granule - 1) << SIZE_CLASS_SHIFT) + 1;
+        while (class_index < allocator->num_pools && allocator->class_sizes[class_index] < n)
+        {
+            class_index++;
+        }
+
+        allocator->size_class_table[granule] = (uint8_t)class_index;
+    }
+
+    class_index = 0;
+    while (class_index < allocator->num_pools && allocator->class_sizes[class_index] <= SIZE_CLASS_TABLE_MAX)
+    {
+        class_index++;
+    }
+
+    allocator->large_class_start = class_index;
+}
+
+static inline pool_header_t* find_pool_from_pointer(pool_allocator_t* allocator, void* ptr)
 {
-    int pool_index = (((byte_ptr_t)ptr) - base_addr) / pool_size;
-    if (pool_index >= 0 && pool_index < num_pools)
+    byte_ptr_t bptr = (byte_ptr_t)ptr;
+    if (bptr < allocator->base_addr || bptr >= allocator->end_addr)
+    {
+        // Blocks carved from the region behind the last pool belong to whichever class it was given to
+        byte_ptr_t trailing = __atomic_load_n(&allocator->trailing_blocks, __ATOMIC_ACQUIRE);
+        if (trailing != NULL && bptr >= trailing && bptr < allocator->heap + allocator->heap_size)
+        {
+            return get_pool(allocator, allocator->trailing_class);
+        }
+
+        // Blocks of the chunks a growable heap took on later are found through its page map
+        span_header_t* span = allocator->page_map == NULL ? NULL : find_chunk_span(allocator, ptr);
+        int class_index = span == NULL ? -1 : __atomic_load_n(&span->class_index, __ATOMIC_RELAXED);
+        return class_index < 0 ? NULL : get_pool(allocator, class_index);
+    }
+
+    // Power of two pool spans turn the division into a shift, and individually sized pools need a search
+    size_t offset = (size_t)(bptr - allocator->base_addr);
+    size_t pool_index;
+    if (allocator->pool_shift)
+    {
+        pool_index = offset >> allocator->pool_shift;
+    }
+    else if (allocator->pool_size)
+    {
+        pool_index = divide_offset(offset, allocator->pool_size, allocator->pool_reciprocal);
+    }
+    else if (allocator->spans != NULL)
+    {
+        // Spans change pools, so the span table records which one each span is carved into
+        int class_index = __atomic_load_n(&allocator->spans[offset >> SPAN_SHIFT].class_index, __ATOMIC_RELAXED);
+        return class_index < 0 ? NULL : get_pool(allocator, class_index);
+    }
+    else
     {
-        return get_pool(pool_index);
+        pool_index = find_pool_from_offset(allocator, offset);
+    }
+    if (pool_index < (size_t)allocator->num_pools)
+    {
+        // Tail slack belongs to the smallest class, and blocks carved into smaller ones to the class they were split into
+        if (allocator->fill_slack && offset >= allocator->slack_offsets[pool_index])
+        {
+            return get_pool(allocator, 0);
+        }
+
+        pool_header_t* pool = get_pool(allocator, pool_index);
+        return allocator->splits == NULL ? pool : find_split_pool(allocator, pool, ptr);
     }
 
     return NULL;
 }
 
-static inline pool_header_t* get_pool(int i)
+static inline int find_pool_from_offset(pool_allocator_t* allocator, size_t offset)
+{
+    // Find the last pool starting at or before the offset. The number of steps only depends on the number
+    // of pools and each step is a conditional move, so frees don't pay for mispredicted branches.
+    const size_t* first = allocator->pool_offsets;
+    size_t count = (size_t)allocator->num_pools;
+    while (count > 1)
+    {
+        size_t half = count / 2;
+        first = first[half] <= offset ? first + half : first;
+        count -= half;
+    }
+
+    return (int)(first - allocator->pool_offsets);
+}
+
+static inline bool pool_contains(pool_allocator_t* allocator, int i, void* ptr)
+{
+    byte_ptr_t base = allocator->base_addr;
+    if (allocator->spans != NULL)
+    {
+        span_header_t* span = get_span(allocator, ptr);
+        return span != NULL && __atomic_load_n(&span->class_index, __ATOMIC_RELAXED) == i;
+    }
+
+    if ((byte_ptr_t)ptr >= base + pool_start_offset(allocator, i) && (byte_ptr_t)ptr < base + pool_end_offset(allocator, i))
+    {
+        return true;
+    }
+
+    // Blocks may also sit in a larger pool's tail slack or the trailing region, or have been split off a larger block
+    return (allocator->splits != NULL || allocator->fill_slack || allocator->trailing_blocks != NULL) &&
+           find_pool_from_pointer(allocator, ptr) == get_pool(allocator, i);
+}
+
+static inline size_t divide_offset(size_t offset, size_t divisor, uint64_t reciprocal)
+{
+    // Exact as long as offset * divisor < 2^64, see plan_reciprocal()
+    return reciprocal ? (size_t)(((unsigned __int128)offset * reciprocal) >> 64) : offset / divisor;
+}
+
+static uint64_t plan_reciprocal(pool_allocator_t* allocator, size_t divisor)
+{
+    // The rounding error of the reciprocal times the offset stays below 2^64 while neither exceeds 2^32.
+    // Larger heaps (and divisors of 1, whose reciprocal doesn't fit) divide.
+    if (divisor < 2 || allocator->heap_size > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    return UINT64_MAX / divisor + 1;
+}
+
+static inline size_t pool_start_offset(pool_allocator_t* allocator, int i)
+{
+    return allocator->pool_size ? (size_t)i * allocator->pool_size : allocator->pool_offsets[i];
+}
+
+static inline size_t pool_end_offset(pool_allocator_t* allocator, int i)
+{
+    // The final pool of an even split may be cut short by the end of the heap
+    if (allocator->pool_size)
+    {
+        return MIN((size_t)(allocator->end_addr - allocator->base_addr), ((size_t)i + 1) * allocator->pool_size);
+    }
+
+    return allocator->pool_offsets[i + 1];
+}
+
+static inline pool_header_t* get_pool(pool_allocator_t* allocator, int i)
 {
-    return (pool_header_t*)(g_pool_heap + (i * sizeof(pool_header_t)));
+    return allocator->pools + i;
 }
 
-static inline int get_pool_index(pool_header_t* pool)
+static inline int get_pool_index(pool_allocator_t* allocator, pool_header_t* pool)
 {
-    return ((uintptr_t)(((byte_ptr_t)pool) - g_pool_heap)) / sizeof(pool_header_t);
+    return (int)(pool - allocator->pools);
 }
 
 inline size_t align(size_t n) { return aligned(n, byte_align); }
@@ -284,7 +4106,12 @@ inline size_t aligned(size_t n, size_t k) { return (n + k - 1) & ~(k - 1); }
 
 void memoryDump(uint8_t mask)
 {
-    if (!initialized)
+    pool_allocator_dump(&g_default_allocator, mask);
+}
+
+void pool_allocator_dump(pool_allocator_t* allocator, uint8_t mask)
+{
+    if (!allocator->initialized)
     {
         printf("Warning: Allocator not initialized.\n");
     }
@@ -293,30 +4120,40 @@ void memoryDump(uint8_t mask)
     {
         printf("---------- Init Information ----------\n\n");
 
-        printf("Byte Alignment: %d\nNumber of Pools: %d\nPool Size (Bytes): %d\n\n",
-               byte_align, num_pools, pool_size);
+        printf("Byte Alignment: %d\nNumber of Pools: %d\nPool Size (Bytes): %zu\n\n",
+               byte_align, allocator->num_pools, allocator->pool_size);
+
+        printf("[Heap]\nStart: %p\nBase: %p\nEnd: %p\nSize (Bytes): %zu\n\n",
+               allocator->heap, allocator->base_addr, allocator->end_addr, allocator->heap_size);
 
-        printf("[Heap]\nStart: %p\nBase: %p\nEnd: %p\n\n",
-               g_pool_heap, base_addr, end_addr);
+        pool_layout_info_t info;
+        if (pool_allocator_layout_info(allocator, &info))
+        {
+            printf("[Layout]\nMode: %s\nHeader Bytes: %zu\nPadding Bytes: %zu\nSlack Bytes: %zu\nRecovered Slack Bytes: %zu\n"
+                   "Trailing Bytes: %zu\nChunks: %zu\nChunk Bytes: %zu\n\n",
+                   info.layout == POOL_LAYOUT_POW2 ? "pow2" : info.layout == POOL_LAYOUT_SPANS ? "spans" : info.layout == POOL_LAYOUT_COMPACT ? "compact" : "even",
+                   info.header_bytes, info.padding_bytes, info.slack_bytes, info.recovered_bytes, info.trailing_bytes, info.chunk_count, info.chunk_bytes);
+        }
     }
 
     if (mask & 0b10)
     {
         printf("------------ Pool Headers ------------\n\n");
 
-        for (int i = 0; i < num_pools; i++)
+        for (int i = 0; i < allocator->num_pools; i++)
         {
-            pool_header_t* pool = get_pool(i);
-            printf("[Pool %d]\nBlock Size (Aligned): %zu (%zu)\nNumber of Blocks: %ld\nNext Free: %p\n\n",
-                   i, pool->block_size, align(pool->block_size), pool_size / align(pool->block_size), pool->next_free);
+            pool_header_t* pool = get_pool(allocator, i);
+            printf("[Pool %d]\nBlock Size (Aligned): %zu (%zu)\nNumber of Blocks: %zu\nNext Free: %p\n\n",
+                   i, pool->block_size, pool->stride, pool->num_blocks, free_list_head(pool));
         }
     }
 
     if (mask & 0b100)
     {
+        pool_header_t* last_used_pool = allocator->last_used_pool;
         printf("---------- Other Information ----------\n\n");
         printf("Last Used Pool: [Pool %d]\nBlock Size: %zu\nNext Free: %p\n\n",
-               get_pool_index(last_used_pool), last_used_pool->block_size, last_used_pool->next_free);
+               get_pool_index(allocator, last_used_pool), last_used_pool->block_size, free_list_head(last_used_pool));
     }
 
     return;
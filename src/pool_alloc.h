@@ -11,15 +11,24 @@
  * 2. The heap is subdivided evenly by number of pools, giving smaller objects more blocks to allocate into.
  *     a. If a smaller block pool is full, new allocations for said block size
  *        may take up blocks in the next non-empty pool of greater block size.
- *     b. There is no coalescing of smaller blocks since those take priority,
- *        though neither is there any splitting of larger blocks.
- * 3. At the beginning of the heap, we hold 24-byte headers identifying pool block size and pointing to first
- * available free block in that pool (NULL if no free blocks are available).
+ *     b. There is no coalescing of smaller blocks since those take priority. Larger blocks are only
+ *        split into blocks of a starving smaller class once an instance opts into splitting.
+ * 3. At the beginning of the heap, we hold read-only headers describing each pool's blocks. The mutable head
+ * pointing to the first available free block of each pool (NULL if none are available) is kept on a cache
+ * line of its own in the allocator instance.
  * 4. There is no header/metadata overhead for allocated blocks, we can simply store a free list where each
  * free block holds a pointer to the next free block. This pointer is simply overwritten when the block is allocated,
  * and restored on pool_free().
  * 5. The memory allocator holds a pointer to the most recently used pool header.
  * 6. All headers, pools, and blocks are aligned in memory according to the size of memory addresses.
+ * 7. All of the above state belongs to an allocator instance (pool_allocator_t), so independent heaps
+ * with their own block sizes may coexist. The global pool_*() functions operate on a default instance.
+ * 8. An instance may opt into a thread caching front end, where each thread keeps per-size-class
+ * magazines of free blocks and only touches the shared pools to refill or flush them in batches.
+ * 9. With LOCK_FREE, the shared free lists are lock-free stacks (CAS on an ABA-tagged head), and lazy
+ * initialization bumps each pool's frontier of fresh blocks atomically, so instances are safe to share between threads.
+ * 10. An instance may be owned by a thread, in which case blocks freed by any other thread are queued on a
+ * lock-free remote-free list that the owner drains back into its pools on its next allocation miss.
  * 
  * Written by Felipe Campos, 11/12/2020.
  */
@@ -34,10 +43,22 @@
 // =================== DEFINITIONS =====================
 
 #define MAX_NUM_POOLS 64
-#define HEAP_SIZE_BYTES 65536
+#define HEAP_SIZE_BYTES 65536 // default heap size, see pool_init_heap() for runtime-sized heaps
 #define POOL_CACHE true
 #define LAZY_INIT true
 #define BINARY_SEARCH true
+#define SIZE_CLASS_TABLE true
+#define FREE_POOL_MASK true
+#define SIZE_CLASS_TABLE_MAX 1024 // largest request size resolved through the dense size-class table
+#define SIZE_CLASS_SHIFT 3        // log2 of the byte granule each size-class table entry covers
+#define LOCK_FREE true
+#define POOL_STATS true
+#define CACHE_LINE_SIZE 64
+#define THREAD_CACHE_BYTES 4096     // default thread cache budget per size class
+#define THREAD_CACHE_MAX_BLOCKS 256 // default cap on blocks cached per size class
+#define PROFILE_GRANULE_MAX 4096    // requests up to this size are profiled in 8-byte buckets, larger ones by power of two
+#define SPAN_SHIFT 12               // log2 of the bytes per span with POOL_LAYOUT_SPANS
+#define SPAN_SIZE_BYTES (1 << SPAN_SHIFT)
 
 /**
  * Header struct occupying a freed block, pointing to the next
@@ -51,20 +72,257 @@ typedef struct block_header
 } block_header_t;
 
 /**
- * Header struct defining a pool size and pointing to
- * the next free block in that pool (NULL if none available).
- * 
- * Note: 24 byte struct assuming 8-byte addressing (12-byte on 32-bit, etc.)
+ * Mutable state of a pool, pointing to the next free block in that pool (NULL if none available).
+ * Every head is padded out to a cache line of its own, so threads working on different pools never
+ * share a line, and nothing else lives on the lines they write.
+ *
+ * `next_free` is a tagged pointer: the low bits hold the address of the first free block and the
+ * high bits a counter bumped on every update, which protects lock-free pops against ABA.
+ * With POOL_STATS, the pool's counters share the line, since every update to them goes with one to `next_free`.
+ */
+typedef struct pool_head
+{
+    uint64_t next_free;
+    size_t num_initialized; // used for lazy init
+    uint64_t allocs;        // statistics (see pool_allocator_get_stats())
+    uint64_t frees;
+    uint64_t peak_live;
+    uint64_t spills_in;
+    uint64_t failures;
+} __attribute__((aligned(CACHE_LINE_SIZE))) pool_head_t;
+
+/**
+ * Header struct describing a pool's size class. Written once by pool_init() and only read afterwards,
+ * with everything the allocation and free paths need precomputed so they don't divide.
+ *
+ * Note: 48 byte struct assuming 8-byte addressing.
  */
 typedef struct pool_header
 {
     size_t block_size;
-    uint16_t num_initialized; // used for lazy init
-    block_header_t* next_free;
+    size_t stride;          // aligned block size, i.e. the distance between neighbouring blocks
+    size_t num_blocks;
+    uint8_t* first_block;   // NULL with POOL_LAYOUT_SPANS, whose blocks come from spans
+    uint64_t reciprocal;    // ceil(2^64 / stride) for dividing offsets by a multiply, 0 if the heap is too large
+    pool_head_t* head;
 } pool_header_t;
 
+/**
+ * Descriptor of one span of the heap with POOL_LAYOUT_SPANS. A table of these sits at the start
+ * of the heap (and of every chunk a growable heap adds), indexed by a block's offset shifted down by SPAN_SHIFT.
+ *
+ * Note: 8 byte struct.
+ */
+typedef struct span_header
+{
+    int32_t live;        // blocks of the span currently out of its pool's free list
+    int16_t class_index; // pool the span is carved into, -1 while it's unused
+    uint16_t free_count; // scratch count of the span's blocks found free while reclaiming
+} span_header_t;
+
 typedef uint8_t* byte_ptr_t;
 
+/**
+ * Opaque handle to an allocator instance owning its own heap and pools.
+ */
+typedef struct pool_allocator pool_allocator_t;
+
+/**
+ * Per-thread cache of free blocks for one allocator instance.
+ */
+typedef struct pool_thread_cache pool_thread_cache_t;
+
+/**
+ * Extra region of spans a growable instance took on after its heap ran out (see pool_allocator_set_growth()).
+ */
+typedef struct pool_chunk pool_chunk_t;
+
+/**
+ * How the heap is carved into pools.
+ *
+ * POOL_LAYOUT_EVEN:  pool headers at the start of the heap, the rest split evenly between pools.
+ * POOL_LAYOUT_POW2:  pool headers kept in the instance, every pool spanning the same power of two
+ *                    bytes and aligned to it, so pointer-to-pool is a subtract-and-shift.
+ * POOL_LAYOUT_SPANS: the heap is cut into SPAN_SIZE_BYTES spans handed to pools as they need them,
+ *                    and fully free spans move to whichever pool runs dry next.
+ * POOL_LAYOUT_COMPACT: pool headers at the start of the heap, then every pool trimmed to a whole number
+ *                    of blocks and packed against the previous one, leaving all the slack as a single
+ *                    trailing region (see pool_allocator_alloc_trailing()).
+ */
+typedef enum pool_layout
+{
+    POOL_LAYOUT_EVEN = 0,
+    POOL_LAYOUT_POW2,
+    POOL_LAYOUT_SPANS,
+    POOL_LAYOUT_COMPACT,
+} pool_layout_t;
+
+/**
+ * How much of the heap each pool gets.
+ *
+ * POOL_CAPACITY_EVEN:     every pool gets the same share of the heap (`capacities` is ignored).
+ * POOL_CAPACITY_WEIGHTS:  pools split the heap in proportion to their `capacities`.
+ * POOL_CAPACITY_BYTES:    `capacities` are byte budgets per pool.
+ * POOL_CAPACITY_BLOCKS:   `capacities` are block counts per pool.
+ */
+typedef enum pool_capacity
+{
+    POOL_CAPACITY_EVEN = 0,
+    POOL_CAPACITY_WEIGHTS,
+    POOL_CAPACITY_BYTES,
+    POOL_CAPACITY_BLOCKS,
+} pool_capacity_t;
+
+/**
+ * Extended initialization options for pool_init_ex().
+ */
+typedef struct pool_config
+{
+    const size_t* block_sizes; // same requirements as pool_init()
+    size_t block_size_count;
+    pool_layout_t layout;
+    pool_capacity_t capacity;
+    const size_t* capacities; // one per block size, interpreted according to `capacity`
+    bool fill_slack;          // thread the slack at the end of every pool onto the smallest class's free list
+    const size_t* alignments; // one power of two per block size (0 for the default), or NULL for all defaults
+} pool_config_t;
+
+/**
+ * Where an initialized instance's heap went, as reported by pool_allocator_layout_info().
+ */
+typedef struct pool_layout_info
+{
+    pool_layout_t layout;
+    size_t pool_span;     // bytes reserved for each pool's blocks (0 if pools differ in size), or per span
+    size_t header_bytes;  // heap bytes taken by pool headers (none with POOL_LAYOUT_POW2) or span descriptors
+    size_t padding_bytes; // heap bytes no pool can use, i.e. the cost of rounding and aligning pool spans
+                          // or whatever byte budgets and block counts leave over
+    size_t slack_bytes;   // bytes at the ends of pools too small for another block, summed over all pools
+                          // (less whatever fill_slack recovered)
+    size_t recovered_bytes; // slack bytes turned into blocks of the smallest class by fill_slack
+    size_t trailing_bytes;  // bytes behind the last pool not yet handed out from the trailing region
+    size_t chunk_count;   // chunks a growable heap added on top of the heap described above
+    size_t chunk_bytes;   // total bytes of those chunks
+} pool_layout_info_t;
+
+/**
+ * Obtain a chunk of `size` bytes for a growable instance, or NULL if no more memory should be used.
+ */
+typedef void* (*pool_chunk_alloc_t)(size_t size, void* context);
+
+/**
+ * Give back a chunk obtained from a pool_chunk_alloc_t when its instance is destroyed.
+ */
+typedef void (*pool_chunk_free_t)(void* chunk, size_t size, void* context);
+
+/**
+ * How a growable instance obtains more memory once its heap runs out (see pool_allocator_set_growth()).
+ */
+typedef struct pool_growth
+{
+    pool_chunk_alloc_t chunk_alloc; // NULL to mmap chunks (unmapped on destroy)
+    pool_chunk_free_t chunk_free;   // releases chunk_alloc's chunks on destroy, may be NULL
+    void* context;                  // passed through to both callbacks
+    size_t chunk_size;              // bytes of the first chunk, 0 for the size of the heap
+    double growth_factor;           // each chunk is this many times the size of the one before, at least 1
+    size_t max_chunk_size;          // cap on the size of a single chunk, 0 for none
+    size_t max_heap_size;           // cap on the bytes of the heap and all of its chunks together, 0 for none
+} pool_growth_t;
+
+/**
+ * Per-class summary of an instance's profiled allocations (see pool_allocator_enable_profiling()).
+ */
+typedef struct pool_profile
+{
+    size_t requests[MAX_NUM_POOLS];  // allocations whose size fits each class best (by histogram bucket)
+    size_t overflows[MAX_NUM_POOLS]; // of those, how many spilled into a larger class or failed
+    size_t peak_live[MAX_NUM_POOLS]; // most blocks of each class allocated at once
+    size_t oversized;                // allocations larger than every class
+} pool_profile_t;
+
+/**
+ * Block sizes and capacities suggested by pool_recommend_config() for the profiled workload.
+ *
+ * `block_sizes` and `block_size_count` can be passed straight to pool_init(), or together with
+ * `block_counts` to pool_init_ex() with POOL_CAPACITY_BLOCKS over a heap of `heap_size` bytes.
+ */
+typedef struct pool_recommendation
+{
+    size_t block_sizes[MAX_NUM_POOLS];
+    size_t block_counts[MAX_NUM_POOLS]; // estimated peak number of live blocks per class
+    size_t block_size_count;
+    size_t heap_size; // bytes needed to hold every class at its peak, headers included
+} pool_recommendation_t;
+
+/**
+ * Per-class counters of an instance's shared pools (see pool_allocator_get_stats()).
+ *
+ * Blocks count as allocated when they leave their pool's free list or frontier, whether for a caller,
+ * a thread cache or a split, and as freed when they rejoin it.
+ */
+typedef struct pool_stats
+{
+    size_t num_classes;
+    size_t block_sizes[MAX_NUM_POOLS];
+    uint64_t allocs[MAX_NUM_POOLS];
+    uint64_t frees[MAX_NUM_POOLS];
+    uint64_t live[MAX_NUM_POOLS];        // blocks currently out of each pool, allocs - frees
+    uint64_t peak_live[MAX_NUM_POOLS];   // most blocks out of each pool at once
+    size_t initialized[MAX_NUM_POOLS];   // blocks behind each pool's lazy init frontier
+    uint64_t spills_in[MAX_NUM_POOLS];   // allocations fitting a smaller class that each pool served
+    uint64_t failures[MAX_NUM_POOLS];    // allocations fitting each class that found no block in it or above
+    uint64_t oversized;                  // allocations larger than every class
+} pool_stats_t;
+
+#define POOL_TRACE_MAGIC {'P', 'T', 'R', 'C'}
+#define POOL_TRACE_VERSION 2
+#define POOL_TRACE_NO_OFFSET UINT32_MAX // event without a block, or one too far into its region
+#define POOL_TRACE_MAX_CHUNK UINT16_MAX // chunks added after this many can't be told apart
+#define POOL_TRACE_NO_POOL UINT8_MAX    // failed request larger than every class
+
+/**
+ * Operations recorded in a trace. POOL_TRACE_SPILL is or'd into POOL_TRACE_ALLOC when the block
+ * came from a larger pool than the one fitting the request.
+ */
+typedef enum pool_trace_op
+{
+    POOL_TRACE_ALLOC = 1,
+    POOL_TRACE_FREE = 2,
+    POOL_TRACE_FAIL = 3,
+    POOL_TRACE_SPILL = 0x80,
+} pool_trace_op_t;
+
+/**
+ * One traced allocation, free or failed allocation (see pool_allocator_enable_trace()).
+ * 16 bytes, so four events share a cache line and none straddles two.
+ */
+typedef struct pool_trace_event
+{
+    uint64_t time : 48;  // ticks since tracing was enabled (wrapping after over a day at 3 GHz), see ticks_per_second
+    uint64_t chunk : 16; // region of the block: 0 for the heap, then growth chunks numbered from 1 as they're added
+    uint32_t offset;     // offset of the block from the start of its region, POOL_TRACE_NO_OFFSET if none
+    uint16_t size;       // requested size, saturated at UINT16_MAX (the block size for classes, 0 for frees)
+    uint8_t op;          // pool_trace_op_t
+    uint8_t pool_index;  // pool the block came from or went back to, the class a failure fit, or POOL_TRACE_NO_POOL
+} pool_trace_event_t;
+
+/**
+ * Header of a trace file written by pool_allocator_dump_trace(), followed by `num_events` events,
+ * oldest first. Fields are in the byte order of the machine that wrote them.
+ */
+typedef struct pool_trace_header
+{
+    char magic[4]; // POOL_TRACE_MAGIC
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t num_pools;
+    uint32_t reserved;
+    uint64_t ticks_per_second;
+    uint64_t num_events;
+    uint64_t dropped_events; // older events the ring overwrote before the dump
+    uint64_t block_sizes[MAX_NUM_POOLS];
+} pool_trace_header_t;
+
 // ============ TUNABLE BLOCK POOL ALLOCATOR ===============
 
 /**
@@ -72,12 +330,30 @@ typedef uint8_t* byte_ptr_t;
  * Returns true on success, false on failure.
  *
  * Notes:
- * 1. This may only be called once per process.
+ * 1. This may only be called once per process (it initializes the default instance).
  * 2. `block_size_count` doesn't exceed 64.
  * 3. `size_t* block_sizes` is pre-sorted and contains no duplicate elements.
  */
 bool pool_init(const size_t* block_sizes, size_t block_size_count);
 
+/**
+ * Initialize the pool allocator with extended options (see pool_config_t).
+ * Returns true on success, false on failure. Mutually exclusive with pool_init().
+ */
+bool pool_init_ex(const pool_config_t* config);
+
+/**
+ * Initialize the pool allocator over a heap of `heap_size` bytes instead of the default static heap.
+ * Returns true on success, false on failure.
+ *
+ * `heap` may be a caller-provided buffer (which must outlive the allocator and need not be zeroed),
+ * or NULL to have the allocator mmap a region of `heap_size` bytes itself. Pages of an mmap'd heap
+ * are only committed as blocks are first handed out.
+ *
+ * Same requirements on `block_sizes` as pool_init(), and mutually exclusive with it.
+ */
+bool pool_init_heap(void* heap, size_t heap_size, const size_t* block_sizes, size_t block_size_count);
+
 /**
  * Allocate n bytes.
  * Returns pointer to allocate memory on success, NULL pointer on failure.
@@ -93,53 +369,400 @@ void* pool_alloc(size_t n);
 */
 void pool_free(void* ptr);
 
-// ================ HELPER FUNCTIONS ==================
+/**
+ * Returns the size class (pool index) that pool_alloc(n) allocates from, or -1 if n is too large.
+ * Meant to be resolved once, e.g. at startup, for use with pool_alloc_class() and pool_free_class().
+ */
+int pool_size_class(size_t n);
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
+/**
+ * Allocate a block from the given size class. Unlike pool_alloc(), never spills into a larger class.
+ * Returns NULL if the class is exhausted.
+ */
+void* pool_alloc_class(int class_id);
 
 /**
- * Gets the pool header corresponding to the ith block size.
+ * Release allocation pointed to by ptr, which was allocated with pool_alloc(n).
+ * Skips the pointer-to-pool division of pool_free() unless the block spilled into a larger pool.
  */
-static pool_header_t* get_pool(int i);
+void pool_free_sized(void* ptr, size_t n);
 
 /**
- * Gets the block size index corresponding to the pool header.
+ * Release allocation pointed to by ptr, which was allocated with pool_alloc_class(class_id).
+ * Skips the pool lookup altogether; debug builds (without NDEBUG) assert that ptr lies in that class's pool.
  */
-static int get_pool_index(pool_header_t* pool);
+void pool_free_class(void* ptr, int class_id);
 
 /**
- * Create a pool header for the ith block size and point it to the pool's first free block.
+ * Allocate n bytes aligned to `alignment` (a power of two) from the smallest class that fits n and was
+ * configured with at least that alignment (see pool_config_t.alignments). Returns NULL if no such class
+ * has a free block. The block is freed like any other, with pool_free().
  */
-static pool_header_t* create_pool_header(size_t block_size, int i);
+void* pool_alloc_aligned(size_t n, size_t alignment);
 
 /**
- * Lazily generates a free list by populating blocks in the given pool's free list on each pool_alloc() call.
- * 
- * Allows for O(N) initialization rather than O(N + M) (N = number of pools, M = total number of blocks)
- * since we don't have to pre-emptively initialize the entire free list for every single block.
+ * Allocate `count` blocks of n bytes each into `out_ptrs`.
+ * Returns the number of blocks allocated, which is less than `count` if the pools run out.
  */
-static void lazy_populate_block_header(pool_header_t* pool);
+size_t pool_alloc_bulk(size_t n, size_t count, void** out_ptrs);
 
 /**
- * Generates a complete free list by populating every block inthe given pool with a block header.
- * 
- * Runs in linear time w.r.t. the number of blocks in a given pool.
+ * Release `count` allocations pointed to by `ptrs`. Same assumptions as pool_free().
  */
-static void populate_block_headers(pool_header_t* pool);
+void pool_free_bulk(void** ptrs, size_t count);
 
 /**
- * Binary search throuogh the pool headers to find the relevant pool.
- * 
- * Runs in O(log(N)) for N pools e.g. worst case 6 loops for 64 pools.
+ * Resize the allocation pointed to by ptr to n bytes, like realloc().
+ * Returns ptr itself if its block already holds n bytes, otherwise moves the contents into a block
+ * fitting n and frees the old one. Returns NULL (leaving ptr allocated) if no block fits n.
  */
-static pool_header_t* find_pool_from_size(size_t n);
+void* pool_realloc(void* ptr, size_t n);
 
 /**
- * Finds the pool header corresponding to the pointer in memory.
- * 
- * Returns NULL if an invalid pointer.
+ * Returns the number of bytes the allocation pointed to by ptr can hold, i.e. the block size of the class
+ * it was allocated from (or spilled into). Containers can grow up to it without calling pool_realloc().
  */
-static pool_header_t* find_pool_from_pointer(void* ptr);
+size_t pool_usable_size(void* ptr);
+
+/**
+ * Allocate a zeroed array of `count` elements of `size` bytes each, like calloc().
+ * Returns NULL if count * size overflows or no block fits it.
+ */
+void* pool_calloc(size_t count, size_t size);
+
+// ============== ALLOCATOR INSTANCES =================
+
+/**
+ * Create a new, uninitialized allocator instance with its own HEAP_SIZE_BYTES heap.
+ * Returns NULL on failure.
+ */
+pool_allocator_t* pool_allocator_create(void);
+
+/**
+ * Create a new, uninitialized allocator instance over a heap of `heap_size` bytes.
+ * `heap` is either a caller-provided buffer or NULL to mmap one (see pool_init_heap()).
+ * Returns NULL on failure.
+ */
+pool_allocator_t* pool_allocator_create_heap(void* heap, size_t heap_size);
+
+/**
+ * Initialize an allocator instance with its own set of block sizes.
+ * Returns true on success, false on failure.
+ *
+ * Same requirements on `block_sizes` as pool_init(). May only be called once per instance.
+ */
+bool pool_allocator_init(pool_allocator_t* allocator, const size_t* block_sizes, size_t block_size_count);
+
+/**
+ * Initialize an allocator instance with extended options (see pool_config_t).
+ * Returns true on success, false on failure.
+ *
+ * With POOL_LAYOUT_POW2, the pool span is the largest power of two for which every pool fits
+ * in the heap once the first one is aligned to it. pool_allocator_layout_info() reports
+ * how much of the heap that rounding leaves unused.
+ *
+ * With POOL_LAYOUT_SPANS, pools start out empty and take SPAN_SIZE_BYTES spans from the heap as they
+ * run dry, so block sizes may not exceed SPAN_SIZE_BYTES and capacities must be POOL_CAPACITY_EVEN.
+ * A pool that runs out of spans reclaims the fully free spans of the other pools before spilling.
+ *
+ * Capacities other than POOL_CAPACITY_EVEN size each pool individually and require POOL_LAYOUT_EVEN
+ * or POOL_LAYOUT_COMPACT.
+ * Fails if the pools don't fit in the heap or any pool can't hold at least one block.
+ *
+ * With `alignments`, every block of a class is aligned to its entry: the block size is rounded up to a
+ * multiple of the alignment (the rounded sizes must still be strictly increasing) and the pool's first
+ * block is aligned to it, so blocks need no per-allocation padding or header. POOL_LAYOUT_POW2 needs pool
+ * spans of at least the largest alignment, and POOL_LAYOUT_SPANS alignments of at most SPAN_SIZE_BYTES.
+ *
+ * With `fill_slack`, the bytes at the end of each pool that can't fit another of its blocks are cut into
+ * blocks of the smallest class instead of going to waste, and pool_free() routes them back to that class.
+ * Not available with POOL_LAYOUT_SPANS.
+ */
+bool pool_allocator_init_ex(pool_allocator_t* allocator, const pool_config_t* config);
+
+/**
+ * Describe how an initialized instance's heap is laid out.
+ * Returns false if the instance isn't initialized.
+ */
+bool pool_allocator_layout_info(pool_allocator_t* allocator, pool_layout_info_t* info);
+
+/**
+ * Allocate n bytes from the given instance.
+ * Returns pointer to allocate memory on success, NULL pointer on failure.
+ */
+void* pool_allocator_alloc(pool_allocator_t* allocator, size_t n);
+
+/**
+ * Release allocation pointed to by ptr back to the instance it was allocated from.
+ */
+void pool_allocator_free(pool_allocator_t* allocator, void* ptr);
+
+/**
+ * Tear down an instance created by pool_allocator_create(), releasing its heap if it was mmap'd.
+ * Every pointer allocated from it becomes invalid. Other instances are unaffected.
+ */
+void pool_allocator_destroy(pool_allocator_t* allocator);
+
+/**
+ * Returns the default instance used by pool_init(), pool_alloc() and pool_free().
+ */
+pool_allocator_t* pool_default_allocator(void);
+
+// ================== SIZED FREES =====================
+
+/**
+ * Instance counterparts of pool_size_class(), pool_alloc_class(), pool_free_sized() and pool_free_class().
+ */
+int pool_allocator_size_class(pool_allocator_t* allocator, size_t n);
+void* pool_allocator_alloc_class(pool_allocator_t* allocator, int class_id);
+void pool_allocator_free_sized(pool_allocator_t* allocator, void* ptr, size_t n);
+void pool_allocator_free_class(pool_allocator_t* allocator, void* ptr, int class_id);
+
+/**
+ * Instance counterpart of pool_alloc_aligned(). Alignments up to sizeof(void*) are met by every block,
+ * so those requests are plain pool_allocator_alloc() calls.
+ */
+void* pool_allocator_alloc_aligned(pool_allocator_t* allocator, size_t n, size_t alignment);
+
+// ================= REALLOCATION =====================
+
+/**
+ * Instance counterparts of pool_realloc() and pool_usable_size().
+ * A NULL ptr makes pool_allocator_realloc() allocate n bytes, and n = 0 frees ptr and returns NULL.
+ * Shrinking never moves a block. pool_allocator_usable_size() returns 0 for pointers the instance doesn't own.
+ */
+void* pool_allocator_realloc(pool_allocator_t* allocator, void* ptr, size_t n);
+size_t pool_allocator_usable_size(pool_allocator_t* allocator, void* ptr);
+
+/**
+ * Instance counterpart of pool_calloc(). Heaps that start out zeroed (the static default heap and mmap'd ones)
+ * hand out never used blocks without clearing them, since lazy init never writes a block before its first
+ * allocation. Recycled blocks, blocks from a thread cache and blocks of caller-provided heaps are cleared.
+ */
+void* pool_allocator_calloc(pool_allocator_t* allocator, size_t count, size_t size);
+
+// ================ BULK OPERATIONS ===================
+
+/**
+ * Allocate `count` blocks of n bytes each from the given instance into `out_ptrs`.
+ * Returns the number of blocks allocated, which is less than `count` if the pools run out.
+ *
+ * The pool is resolved once per batch and blocks are detached from its free list with a single
+ * head update, with any shortfall carved from the pool's uninitialized blocks in one claim.
+ * Blocks spill into larger pools exactly like pool_allocator_alloc() once the fitting pool runs dry.
+ */
+size_t pool_allocator_alloc_bulk(pool_allocator_t* allocator, size_t n, size_t count, void** out_ptrs);
+
+/**
+ * Release `count` allocations pointed to by `ptrs` back to the instance they were allocated from.
+ *
+ * Blocks are grouped by pool and each group is spliced onto its pool's free list with one head update
+ * (or onto the remote-free queue with one push, from a thread that doesn't own the instance).
+ */
+void pool_allocator_free_bulk(pool_allocator_t* allocator, void** ptrs, size_t count);
+
+// ================= THREAD CACHE ====================
+
+/**
+ * Enable the thread caching front end on an initialized instance.
+ * Returns true on success, false on failure.
+ *
+ * Once enabled, the instance may be used from any number of threads concurrently. Each thread
+ * allocates from and frees into its own per-size-class magazines, refilled from and flushed to
+ * the shared pools in batches. A thread's cache is flushed automatically when it exits.
+ *
+ * Must be called before the instance is shared between threads. Without LOCK_FREE, refills
+ * and flushes take a per-instance lock. Blocks sitting in one thread's
+ * cache aren't available to other threads until they are flushed.
+ */
+bool pool_allocator_enable_thread_cache(pool_allocator_t* allocator);
+
+/**
+ * Set how many free blocks of the `class_index`th block size each thread may cache.
+ * Refills fetch half that many blocks at once, and overflowing caches are flushed down to half.
+ * A capacity of 0 disables caching for that class.
+ */
+bool pool_allocator_set_cache_capacity(pool_allocator_t* allocator, int class_index, size_t capacity);
+
+/**
+ * Return every block cached by the calling thread to the instance's shared pools.
+ */
+void pool_allocator_flush_thread_cache(pool_allocator_t* allocator);
+
+/**
+ * Thread caching wrappers for the default instance.
+ */
+bool pool_enable_thread_cache(void);
+void pool_flush_thread_cache(void);
+
+// ================= REMOTE FREES ====================
+
+/**
+ * Make the calling thread the owner of an initialized instance.
+ * Returns true on success, false on failure.
+ *
+ * From then on, pool_allocator_free() calls from any other thread don't touch the pools. They push
+ * the block onto the instance's remote-free queue instead (a multi-producer, single-consumer lock-free
+ * list), which the owner drains back into its pools in one batch on its next allocation miss.
+ * Should be called before the instance is shared, or by a new owner once the old one is done with it.
+ */
+bool pool_allocator_set_owner(pool_allocator_t* allocator);
+
+/**
+ * Return every block on the instance's remote-free queue to its pool right away.
+ * Meant to be called by the owner (e.g. when idle). Returns the number of blocks reclaimed.
+ */
+size_t pool_allocator_drain_remote_frees(pool_allocator_t* allocator);
+
+// ===================== SPANS =======================
+
+/**
+ * Move every fully free span of an instance laid out with POOL_LAYOUT_SPANS out of its pool
+ * and back into the shared span pool. Returns the number of spans released.
+ *
+ * Pools already do this on their own once they can't get a span any other way, so this is only
+ * needed to hand memory back ahead of a known shift in allocation sizes.
+ */
+size_t pool_allocator_reclaim_spans(pool_allocator_t* allocator);
+
+/**
+ * Let an initialized instance laid out with POOL_LAYOUT_SPANS grow past its heap. Once every span is in use
+ * and none can be reclaimed, the instance obtains another chunk according to `growth`, cuts it into spans
+ * and hands them out like those of the heap, until a limit is hit or the chunk allocator returns NULL.
+ * Returns true on success, false on failure (including when growth was already enabled).
+ *
+ * Blocks of the heap are still found by a subtract-and-shift, blocks of chunks through a three level
+ * page map, so lookups stay O(1) however many chunks there are. Chunks are kept until destroy.
+ */
+bool pool_allocator_set_growth(pool_allocator_t* allocator, const pool_growth_t* growth);
+
+/**
+ * Growth for the default instance.
+ */
+bool pool_set_growth(const pool_growth_t* growth);
+
+// ================ TRAILING REGION ==================
+
+/**
+ * Allocate `n` bytes from the region behind the last pool, which POOL_LAYOUT_COMPACT (and byte budgets
+ * or block counts that don't fill the heap) leave unused. Bump allocated, so pool_free() ignores these
+ * and they live as long as the instance. Returns NULL once the region is used up or with POOL_LAYOUT_SPANS.
+ */
+void* pool_allocator_alloc_trailing(pool_allocator_t* allocator, size_t n);
+
+/**
+ * Carve whatever is left of the trailing region into blocks of class `class_id` and push them onto its
+ * free list, where pool_free() finds them like any other block of the class. Only the first call
+ * carves anything. Returns the number of blocks added.
+ */
+size_t pool_allocator_give_trailing(pool_allocator_t* allocator, int class_id);
+
+/**
+ * Trailing region of the default instance.
+ */
+void* pool_alloc_trailing(size_t n);
+size_t pool_give_trailing(int class_id);
+
+// ================ BLOCK SPLITTING ==================
+
+/**
+ * Let an initialized instance carve a free block of a larger pool into blocks of the class fitting a request,
+ * instead of spilling the request into the larger block whole, once the fitting pool runs dry.
+ * Returns true on success, false on failure (including when splitting was already enabled).
+ *
+ * Costs a byte per block of the heap, recording which class each block was split into, and a lookup in
+ * that record on every pool_free(). Split blocks stay with the smaller class until the instance is destroyed,
+ * and blocks that were themselves split off a larger one are never split again.
+ * Not available with POOL_LAYOUT_SPANS, whose pools already take memory from each other a span at a time.
+ */
+bool pool_allocator_enable_splitting(pool_allocator_t* allocator);
+
+/**
+ * Splitting for the default instance.
+ */
+bool pool_enable_splitting(void);
+
+// =================== PROFILING =====================
+
+/**
+ * Start recording a histogram of requested sizes, per-class peak live counts and overflow events
+ * on an initialized instance. Returns true on success, false on failure.
+ *
+ * Costs a few relaxed atomic increments per allocation and free. Meant to be enabled right after
+ * initialization, so that every block freed was also counted when it was allocated.
+ */
+bool pool_allocator_enable_profiling(pool_allocator_t* allocator);
+
+/**
+ * Copy the per-class summary of everything profiled so far.
+ * Returns false if profiling isn't enabled.
+ */
+bool pool_allocator_get_profile(pool_allocator_t* allocator, pool_profile_t* profile);
+
+/**
+ * Suggest block sizes and capacities minimizing the heap needed by the profiled workload.
+ * Returns false if profiling isn't enabled or nothing was allocated yet.
+ *
+ * Each class's peak live count is spread over the request sizes that fit it in proportion to how often
+ * they were requested, then the observed sizes are partitioned into at most MAX_NUM_POOLS classes
+ * minimizing the bytes of blocks (plus a pool header per class) needed to hold those peaks.
+ */
+bool pool_allocator_recommend_config(pool_allocator_t* allocator, pool_recommendation_t* recommendation);
+
+/**
+ * Profiling wrappers for the default instance.
+ */
+bool pool_enable_profiling(void);
+bool pool_get_profile(pool_profile_t* profile);
+bool pool_recommend_config(pool_recommendation_t* recommendation);
+
+// ================== STATISTICS ======================
+
+/**
+ * Copy an instance's per-class counters. Returns false if the instance isn't initialized
+ * or the counters were compiled out (POOL_STATS false).
+ *
+ * Counting costs a load and a store on the pool's head line per allocation and free (plus a compare
+ * for the peak), and nothing at all without POOL_STATS. Like profiling, the counters aren't bumped with
+ * locked instructions, so threads racing on one pool may drop counts, and they are read one at a time
+ * while other threads may keep allocating.
+ */
+bool pool_allocator_get_stats(pool_allocator_t* allocator, pool_stats_t* stats);
+
+/**
+ * Statistics of the default instance.
+ */
+bool pool_get_stats(pool_stats_t* stats);
+
+// =================== TRACING ========================
+
+/**
+ * Start recording every allocation, free and failed allocation of an initialized instance into a ring
+ * of `capacity` events (rounded up to a power of two), each a single 16-byte store. If `failure_path`
+ * isn't NULL, a failed allocation dumps the ring there, at most once per ring's worth of new events.
+ * Returns true on success, false on failure.
+ *
+ * Slots are claimed without a locked instruction, so threads racing on the same instance may overwrite
+ * each other's events. Pointer lookups make tracing cost about as much as profiling.
+ */
+bool pool_allocator_enable_trace(pool_allocator_t* allocator, size_t capacity, const char* failure_path);
+
+/**
+ * Write the events currently in the ring to `path` (see pool_trace_header_t).
+ * Returns false if tracing isn't enabled or the file can't be written.
+ */
+bool pool_allocator_dump_trace(pool_allocator_t* allocator, const char* path);
+
+/**
+ * Tracing wrappers for the default instance.
+ */
+bool pool_enable_trace(size_t capacity, const char* failure_path);
+bool pool_dump_trace(const char* path);
+
+// ================ HELPER FUNCTIONS ==================
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 /**
  * "Overloaded" aligned function, but specific to a pool allocator instance since it uses byte_align.
@@ -157,4 +780,6 @@ size_t aligned(size_t n, size_t k);
 
 void memoryDump(uint8_t mask);
 
+void pool_allocator_dump(pool_allocator_t* allocator, uint8_t mask);
+
 #endif /* POOL_ALLOC_H */
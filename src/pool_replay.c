@@ -0,0 +1,590 @@
+/**
+ * Replays an allocation trace against the pool allocator and against the system allocator,
+ * reporting throughput, latency percentiles, peak footprint and failure counts for both.
+ *
+ * Usage: pool_replay [-b sizes] [-H heap_bytes] [-l layout] trace
+ *
+ *   -b  comma separated block sizes, in increasing order (default: those in a binary trace's header)
+ *   -H  heap size in bytes (default: HEAP_SIZE_BYTES)
+ *   -l  pool layout: even (default), pow2, compact or spans
+ *
+ * Traces are either binary files written by pool_dump_trace() (see pool_trace_header_t), or text
+ * files with one event per line:
+ *
+ *   a <id> <size>   allocate <size> bytes as allocation <id>
+ *   f <id>          free allocation <id>
+ *
+ * Blank lines and lines starting with '#' are ignored. An id may be reused once its allocation is freed.
+ * Failed allocations of a binary trace are retried and, if they succeed, freed right away. Frees of blocks
+ * allocated before the trace begins (e.g. whose allocation the ring overwrote) are skipped, and so are
+ * events of blocks lying more than 4 GB into their region, which have no offset to tell them apart.
+ *
+ * Both passes over the trace (untimed for the throughput, then timed per operation for the latencies)
+ * run on the same instance for each allocator: one pool instance, and the process heap for malloc().
+ * Every block is freed at the end of a pass, so both timed passes start from an allocator warmed up by
+ * the same traffic.
+ */
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pool_alloc.h"
+
+// =================== DEFINITIONS =====================
+
+#define REPLAY_ALLOC 0
+#define REPLAY_FREE 1
+
+/**
+ * One replayed event. Every allocation gets a slot of its own, which its free refers back to.
+ */
+typedef struct replay_op
+{
+    uint32_t slot;
+    uint32_t size;
+    uint8_t op;
+} replay_op_t;
+
+typedef struct replay_trace
+{
+    replay_op_t* ops;
+    size_t num_ops;
+    size_t capacity;
+    size_t num_slots;       // allocations in the trace
+    size_t unmatched_frees; // frees of allocations the trace doesn't contain, left out of the replay
+    size_t no_offset;       // binary trace allocations and frees of blocks without an offset, left out too
+    size_t block_sizes[MAX_NUM_POOLS];
+    size_t block_size_count;
+} replay_trace_t;
+
+/**
+ * Maps trace ids (or block offsets of binary traces) to the slot of their latest allocation.
+ * Open addressing with linear probing. Entries are only ever updated, never removed.
+ */
+typedef struct replay_map
+{
+    uint64_t* keys;
+    uint32_t* slots;
+    bool* used;
+    size_t mask;
+} replay_map_t;
+
+/**
+ * Allocator under test, so both replays share one loop.
+ */
+typedef struct replay_target
+{
+    const char* name;
+    void* (*alloc)(void* context, size_t n);
+    void (*free)(void* context, void* ptr);
+    size_t (*usable_size)(void* context, void* ptr);
+    void* context;
+} replay_target_t;
+
+typedef struct replay_result
+{
+    double seconds;
+    uint32_t* alloc_ns; // per-operation latencies, sorted after the timed pass
+    uint32_t* free_ns;
+    size_t num_allocs;
+    size_t num_frees;
+    size_t peak_bytes; // most usable bytes of live blocks at once
+    size_t failures;
+} replay_result_t;
+
+// ================ TRACE LOADING ==================
+
+static bool map_init(replay_map_t* map, size_t count)
+{
+    size_t capacity = 16;
+    while (capacity < 2 * count)
+    {
+        capacity <<= 1;
+    }
+
+    map->keys = malloc(capacity * sizeof(*map->keys));
+    map->slots = malloc(capacity * sizeof(*map->slots));
+    map->used = calloc(capacity, sizeof(*map->used));
+    map->mask = capacity - 1;
+
+    return map->keys != NULL && map->slots != NULL && map->used != NULL;
+}
+
+static void map_release(replay_map_t* map)
+{
+    free(map->keys);
+    free(map->slots);
+    free(map->used);
+}
+
+static size_t map_find(replay_map_t* map, uint64_t key)
+{
+    size_t i = (size_t)(key * 0x9E3779B97F4A7C15ull) & map->mask;
+    while (map->used[i] && map->keys[i] != key)
+    {
+        i = (i + 1) & map->mask;
+    }
+
+    return i;
+}
+
+static bool push_op(replay_trace_t* trace, uint8_t op, uint32_t slot, uint32_t size)
+{
+    if (trace->num_ops == trace->capacity)
+    {
+        size_t capacity = trace->capacity ? 2 * trace->capacity : 1024;
+        replay_op_t* ops = realloc(trace->ops, capacity * sizeof(*ops));
+        if (ops == NULL)
+        {
+            return false;
+        }
+
+        trace->ops = ops;
+        trace->capacity = capacity;
+    }
+
+    trace->ops[trace->num_ops++] = (replay_op_t){.slot = slot, .size = size, .op = op};
+    return true;
+}
+
+/**
+ * Append an allocation of `key`, or its free, to the replay.
+ * Keys stand for allocations as long as they're live, so the map always points at the latest one.
+ */
+static bool add_event(replay_trace_t* trace, replay_map_t* map, bool is_alloc, uint64_t key, size_t size)
+{
+    size_t i = map_find(map, key);
+    if (is_alloc)
+    {
+        map->used[i] = true;
+        map->keys[i] = key;
+        map->slots[i] = (uint32_t)trace->num_slots;
+        return push_op(trace, REPLAY_ALLOC, (uint32_t)trace->num_slots++, (uint32_t)size);
+    }
+
+    if (!map->used[i] || map->slots[i] == UINT32_MAX)
+    {
+        trace->unmatched_frees++;
+        return true;
+    }
+
+    uint32_t slot = map->slots[i];
+    map->slots[i] = UINT32_MAX;
+    return push_op(trace, REPLAY_FREE, slot, 0);
+}
+
+static bool load_binary_trace(FILE* file, replay_trace_t* trace)
+{
+    pool_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.version != POOL_TRACE_VERSION ||
+        header.event_size != sizeof(pool_trace_event_t) || header.num_pools > MAX_NUM_POOLS)
+    {
+        fprintf(stderr, "pool_replay: unsupported binary trace\n");
+        return false;
+    }
+
+    trace->block_size_count = header.num_pools;
+    for (size_t i = 0; i < header.num_pools; i++)
+    {
+        trace->block_sizes[i] = header.block_sizes[i];
+    }
+
+    replay_map_t map;
+    bool loaded = map_init(&map, header.num_events);
+    pool_trace_event_t event;
+    for (uint64_t e = 0; loaded && e < header.num_events && fread(&event, sizeof(event), 1, file) == 1; e++)
+    {
+        // Blocks are identified by their chunk and offset while they're live. Those too far into their
+        // region to have an offset can't be told apart, so they're left out rather than paired up wrongly.
+        uint8_t op = event.op & ~POOL_TRACE_SPILL;
+        uint64_t key = ((uint64_t)event.chunk << 32) | event.offset;
+        if ((op == POOL_TRACE_ALLOC || op == POOL_TRACE_FREE) && event.offset == POOL_TRACE_NO_OFFSET)
+        {
+            trace->no_offset++;
+        }
+        else if (op == POOL_TRACE_ALLOC)
+        {
+            loaded = add_event(trace, &map, true, key, event.size);
+        }
+        else if (op == POOL_TRACE_FAIL)
+        {
+            // Failed allocations have no offset, and no free to end them. Retry them and hand the block
+            // straight back, so a config that fits them doesn't leak.
+            uint64_t failure = ((uint64_t)(POOL_TRACE_MAX_CHUNK + 1) << 32) + e;
+            loaded = add_event(trace, &map, true, failure, event.size) && add_event(trace, &map, false, failure, 0);
+        }
+        else if (op == POOL_TRACE_FREE)
+        {
+            loaded = add_event(trace, &map, false, key, 0);
+        }
+    }
+
+    map_release(&map);
+    return loaded;
+}
+
+static bool load_text_trace(FILE* file, replay_trace_t* trace)
+{
+    replay_map_t map;
+    if (!map_init(&map, 1 << 16))
+    {
+        return false;
+    }
+
+    char line[256];
+    size_t line_number = 0;
+    bool loaded = true;
+    while (loaded && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+        char op;
+        unsigned long long id, size = 0;
+        int fields = sscanf(line, " %c %llu %llu", &op, &id, &size);
+        if (fields <= 0 || op == '#')
+        {
+            continue;
+        }
+
+        if (!((op == 'a' && fields == 3) || (op == 'f' && fields >= 2)) || size > UINT32_MAX)
+        {
+            fprintf(stderr, "pool_replay: malformed event on line %zu\n", line_number);
+            loaded = false;
+            break;
+        }
+
+        // Keep the map at most half full, so probes stay short
+        if (2 * (trace->num_slots + 1) > map.mask)
+        {
+            replay_map_t grown;
+            loaded = map_init(&grown, map.mask + 1);
+            for (size_t i = 0; loaded && i <= map.mask; i++)
+            {
+                if (map.used[i])
+                {
+                    size_t j = map_find(&grown, map.keys[i]);
+                    grown.used[j] = true;
+                    grown.keys[j] = map.keys[i];
+                    grown.slots[j] = map.slots[i];
+                }
+            }
+            map_release(&map);
+            map = grown;
+        }
+
+        loaded = loaded && add_event(trace, &map, op == 'a', id, size);
+    }
+
+    map_release(&map);
+    return loaded;
+}
+
+static bool load_trace(const char* path, replay_trace_t* trace)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "pool_replay: can't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char magic[4] = POOL_TRACE_MAGIC;
+    char start[4] = {0};
+    bool binary = fread(start, 1, sizeof(start), file) == sizeof(start) && memcmp(start, magic, sizeof(magic)) == 0;
+    rewind(file);
+
+    bool loaded = binary ? load_binary_trace(file, trace) : load_text_trace(file, trace);
+    fclose(file);
+
+    return loaded;
+}
+
+// ================ REPLAY ==================
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static int compare_latencies(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Replay the whole trace once. With `latencies`, every operation is timed on its own (less the cost of
+ * reading the clock), otherwise only the whole run is, for the throughput. Frees of failed allocations
+ * are skipped.
+ */
+static void replay(replay_trace_t* trace, replay_target_t* target, void** ptrs, replay_result_t* result,
+                   bool latencies)
+{
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; latencies && i < 1000; i++)
+    {
+        uint64_t start = now_ns();
+        uint64_t delta = now_ns() - start;
+        overhead = delta < overhead ? delta : overhead;
+    }
+
+    size_t live_bytes = 0;
+    result->num_allocs = result->num_frees = result->peak_bytes = result->failures = 0;
+    uint64_t run_start = now_ns();
+    for (size_t i = 0; i < trace->num_ops; i++)
+    {
+        replay_op_t* op = &trace->ops[i];
+        uint64_t start = latencies ? now_ns() : 0;
+        if (op->op == REPLAY_ALLOC)
+        {
+            void* ptr = target->alloc(target->context, op->size);
+            ptrs[op->slot] = ptr;
+            if (!latencies)
+            {
+                continue;
+            }
+
+            uint64_t delta = now_ns() - start;
+            result->alloc_ns[result->num_allocs++] = (uint32_t)(delta > overhead ? delta - overhead : 0);
+            if (ptr == NULL)
+            {
+                result->failures++;
+                continue;
+            }
+
+            live_bytes += target->usable_size(target->context, ptr);
+            result->peak_bytes = live_bytes > result->peak_bytes ? live_bytes : result->peak_bytes;
+        }
+        else if (ptrs[op->slot] != NULL)
+        {
+            size_t usable = latencies ? target->usable_size(target->context, ptrs[op->slot]) : 0;
+            start = latencies ? now_ns() : 0;
+            target->free(target->context, ptrs[op->slot]);
+            ptrs[op->slot] = NULL;
+            if (!latencies)
+            {
+                continue;
+            }
+
+            uint64_t delta = now_ns() - start;
+            result->free_ns[result->num_frees++] = (uint32_t)(delta > overhead ? delta - overhead : 0);
+            live_bytes -= usable;
+        }
+    }
+
+    if (!latencies)
+    {
+        result->seconds = (now_ns() - run_start) * 1e-9;
+    }
+
+    // Release whatever the trace leaves allocated, so the next pass starts with every block free
+    for (size_t slot = 0; slot < trace->num_slots; slot++)
+    {
+        if (ptrs[slot] != NULL)
+        {
+            target->free(target->context, ptrs[slot]);
+            ptrs[slot] = NULL;
+        }
+    }
+}
+
+static void report(replay_target_t* target, replay_trace_t* trace, replay_result_t* result)
+{
+    qsort(result->alloc_ns, result->num_allocs, sizeof(uint32_t), compare_latencies);
+    qsort(result->free_ns, result->num_frees, sizeof(uint32_t), compare_latencies);
+
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    printf("%-8s %9.2f Mops/s  alloc ns", target->name, trace->num_ops / result->seconds * 1e-6);
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+    {
+        printf(" %5u", result->num_allocs ? result->alloc_ns[(size_t)(quantiles[q] * (result->num_allocs - 1))] : 0);
+    }
+    printf(" %7u  free ns", result->num_allocs ? result->alloc_ns[result->num_allocs - 1] : 0);
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+    {
+        printf(" %5u", result->num_frees ? result->free_ns[(size_t)(quantiles[q] * (result->num_frees - 1))] : 0);
+    }
+    printf(" %7u  peak %10zu B  failures %zu\n", result->num_frees ? result->free_ns[result->num_frees - 1] : 0,
+           result->peak_bytes, result->failures);
+}
+
+// ================ ALLOCATORS UNDER TEST ==================
+
+static void* pool_target_alloc(void* context, size_t n)
+{
+    return pool_allocator_alloc(context, n);
+}
+
+static void pool_target_free(void* context, void* ptr)
+{
+    pool_allocator_free(context, ptr);
+}
+
+static size_t pool_target_usable_size(void* context, void* ptr)
+{
+    return pool_allocator_usable_size(context, ptr);
+}
+
+static void* system_target_alloc(void* context, size_t n)
+{
+    (void)context;
+    return malloc(n);
+}
+
+static void system_target_free(void* context, void* ptr)
+{
+    (void)context;
+    free(ptr);
+}
+
+static size_t system_target_usable_size(void* context, void* ptr)
+{
+    (void)context;
+    return malloc_usable_size(ptr);
+}
+
+static pool_allocator_t* create_pool(replay_trace_t* trace, size_t heap_size, pool_layout_t layout)
+{
+    pool_config_t config = {
+        .block_sizes = trace->block_sizes,
+        .block_size_count = trace->block_size_count,
+        .layout = layout,
+        .capacity = POOL_CAPACITY_EVEN,
+    };
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, heap_size);
+    if (allocator != NULL && !pool_allocator_init_ex(allocator, &config))
+    {
+        pool_allocator_destroy(allocator);
+        return NULL;
+    }
+
+    return allocator;
+}
+
+static bool parse_block_sizes(char* list, replay_trace_t* trace)
+{
+    trace->block_size_count = 0;
+    for (char* token = strtok(list, ","); token != NULL; token = strtok(NULL, ","))
+    {
+        if (trace->block_size_count == MAX_NUM_POOLS)
+        {
+            return false;
+        }
+
+        trace->block_sizes[trace->block_size_count++] = strtoull(token, NULL, 10);
+    }
+
+    return trace->block_size_count > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    replay_trace_t trace = {0};
+    char* block_sizes = NULL;
+    size_t heap_size = HEAP_SIZE_BYTES;
+    pool_layout_t layout = POOL_LAYOUT_EVEN;
+    const char* layouts[] = {"even", "pow2", "spans", "compact"};
+    const pool_layout_t layout_values[] = {POOL_LAYOUT_EVEN, POOL_LAYOUT_POW2, POOL_LAYOUT_SPANS, POOL_LAYOUT_COMPACT};
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:H:l:")) != -1)
+    {
+        if (opt == 'b')
+        {
+            block_sizes = optarg;
+        }
+        else if (opt == 'H')
+        {
+            heap_size = strtoull(optarg, NULL, 10);
+        }
+        else if (opt == 'l')
+        {
+            size_t i = 0;
+            while (i < 4 && strcmp(optarg, layouts[i]) != 0)
+            {
+                i++;
+            }
+            if (i == 4)
+            {
+                fprintf(stderr, "pool_replay: unknown layout %s\n", optarg);
+                return 1;
+            }
+            layout = layout_values[i];
+        }
+        else
+        {
+            optind = argc + 1;
+            break;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-b sizes] [-H heap_bytes] [-l even|pow2|compact|spans] trace\n", argv[0]);
+        return 1;
+    }
+
+    if (!load_trace(argv[optind], &trace))
+    {
+        return 1;
+    }
+
+    // Block sizes given on the command line override the ones a binary trace was recorded with
+    if ((block_sizes != NULL && !parse_block_sizes(block_sizes, &trace)) || trace.block_size_count == 0)
+    {
+        fprintf(stderr, "pool_replay: pass up to %d block sizes with -b\n", MAX_NUM_POOLS);
+        return 1;
+    }
+
+    pool_allocator_t* allocator = create_pool(&trace, heap_size, layout);
+    if (allocator == NULL)
+    {
+        fprintf(stderr, "pool_replay: the block sizes don't fit a %zu byte heap\n", heap_size);
+        return 1;
+    }
+
+    printf("trace: %zu events, %zu allocations, %zu unmatched frees and %zu events without an offset skipped\n",
+           trace.num_ops, trace.num_slots, trace.unmatched_frees, trace.no_offset);
+    printf("pool: %zu classes, %zu byte heap\n", trace.block_size_count, heap_size);
+    printf("latency percentiles: p50 p90 p99 p99.9 max\n");
+
+    replay_result_t result = {
+        .alloc_ns = malloc((trace.num_slots + 1) * sizeof(uint32_t)),
+        .free_ns = malloc((trace.num_slots + 1) * sizeof(uint32_t)),
+    };
+    void** ptrs = calloc(trace.num_slots + 1, sizeof(void*));
+    if (result.alloc_ns == NULL || result.free_ns == NULL || ptrs == NULL)
+    {
+        fprintf(stderr, "pool_replay: out of memory\n");
+        return 1;
+    }
+
+    replay_target_t targets[] = {
+        {"pool", pool_target_alloc, pool_target_free, pool_target_usable_size, allocator},
+        {"malloc", system_target_alloc, system_target_free, system_target_usable_size, NULL},
+    };
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++)
+    {
+        replay(&trace, &targets[t], ptrs, &result, false);
+        replay(&trace, &targets[t], ptrs, &result, true);
+        report(&targets[t], &trace, &result);
+    }
+
+    pool_allocator_destroy(allocator);
+    free(ptrs);
+    free(result.alloc_ns);
+    free(result.free_ns);
+    free(trace.ops);
+
+    return 0;
+}
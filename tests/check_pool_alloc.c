@@ -6,10 +6,14 @@
 
 #include <check.h>
 #include <config.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "pool_alloc_tests.h"
 #include "../src/pool_alloc.h"
@@ -573,6 +577,2845 @@ START_TEST(alloc_all_sizes)
 }
 END_TEST
 
+// ================= ALLOCATOR INSTANCE TESTS =====================
+
+/**
+ * Independent instances each own their own heap and block sizes.
+ */
+START_TEST(instance_independent)
+{
+    const size_t arr_a[] = {8, 64};
+    const size_t arr_b[] = {16, 32, 128};
+
+    pool_allocator_t* a = pool_allocator_create();
+    pool_allocator_t* b = pool_allocator_create();
+    ck_assert_ptr_nonnull(a);
+    ck_assert_ptr_nonnull(b);
+
+    ck_assert(pool_allocator_init(a, arr_a, 2));
+    ck_assert(pool_allocator_init(b, arr_b, 3));
+
+    // Exhaust the smallest pool of the first instance
+    uint8_t* last_a = NULL;
+    for (int i = 0; i < pool_size_bytes(2) / align(arr_a[0]); i++)
+    {
+        last_a = pool_allocator_alloc(a, arr_a[0]);
+        ck_assert(last_a != NULL);
+    }
+
+    // The second instance is unaffected and hands out memory from a different heap
+    uint8_t* first_b = pool_allocator_alloc(b, arr_b[0]);
+    ck_assert(first_b != NULL);
+    ck_assert(first_b != last_a);
+
+    // Freeing into one instance only makes memory available in that instance
+    pool_allocator_free(a, last_a);
+    ck_assert_ptr_eq(pool_allocator_alloc(a, arr_a[0]), last_a);
+
+    pool_allocator_free(b, first_b);
+    ck_assert_ptr_eq(pool_allocator_alloc(b, arr_b[0]), first_b);
+
+    pool_allocator_destroy(a);
+    pool_allocator_destroy(b);
+}
+END_TEST
+
+/**
+ * Instances may only be initialized once, while a fresh instance can always be created.
+ */
+START_TEST(instance_reinit)
+{
+    const size_t arr[] = {sizeof(int), 1024, 2048};
+
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+    ck_assert(!pool_allocator_init(allocator, arr, 3));
+    ck_assert(pool_allocator_alloc(allocator, sizeof(int)) != NULL);
+    pool_allocator_destroy(allocator);
+
+    allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+    ck_assert(pool_allocator_alloc(allocator, 2048) != NULL);
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Uninitialized and NULL instances refuse to allocate.
+ */
+START_TEST(instance_uninitialized)
+{
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_alloc(allocator, 8) == NULL);
+    ck_assert(pool_allocator_alloc(NULL, 8) == NULL);
+    ck_assert(!pool_allocator_init(NULL, block_sizes, 1));
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * The global API is a thin wrapper over the default instance.
+ */
+START_TEST(instance_default_wrapper)
+{
+    const size_t arr[] = {sizeof(int)};
+    ck_assert(pool_init(arr, 1));
+
+    pool_allocator_t* allocator = pool_default_allocator();
+    int* p1 = pool_alloc(sizeof(int));
+    ck_assert(p1 != NULL);
+    pool_allocator_free(allocator, p1);
+
+    int* p2 = pool_allocator_alloc(allocator, sizeof(int));
+    ck_assert_ptr_eq(p2, p1);
+    pool_free(p2);
+
+    // The default instance can't be torn down
+    pool_allocator_destroy(allocator);
+    ck_assert_ptr_eq(pool_alloc(sizeof(int)), p1);
+}
+END_TEST
+
+// ================= RUNTIME-SIZED HEAP TESTS =====================
+
+/**
+ * A dirty, caller-provided buffer larger than the default heap.
+ */
+START_TEST(heap_caller_buffer)
+{
+    const size_t heap_size = 4 * HEAP_SIZE_BYTES;
+    const size_t arr[] = {8, 64, 4096};
+    uint8_t* buffer = malloc(heap_size);
+    memset(buffer, 0xAB, heap_size);
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(buffer, heap_size);
+    ck_assert(allocator != NULL);
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+
+    // The largest pool can't spill anywhere, so it holds exactly its share of blocks
+    size_t pool_size = heap_pool_size_bytes(heap_size, 3);
+    uint8_t* first = NULL;
+    uint8_t* last = NULL;
+    size_t count = fill_allocator_pool(allocator, arr[2], &first, &last);
+    ck_assert_msg(count == (heap_size - 3 * sizeof(pool_header_t) - 2 * pool_size) / arr[2],
+                  "Found %zu blocks", count);
+    ck_assert(first >= buffer && last + arr[2] <= buffer + heap_size);
+
+    pool_allocator_free(allocator, last);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, arr[2]), last);
+
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+/**
+ * Caller-provided buffers don't need to be aligned.
+ */
+START_TEST(heap_unaligned_buffer)
+{
+    const size_t arr[] = {sizeof(int), 1024};
+    uint8_t* buffer = malloc(HEAP_SIZE_BYTES + 3);
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(buffer + 3, HEAP_SIZE_BYTES);
+    ck_assert(allocator != NULL);
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    uint8_t* ptr = pool_allocator_alloc(allocator, sizeof(int));
+    ck_assert(ptr != NULL);
+    ck_assert((uintptr_t)ptr % sizeof(void*) == 0);
+
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+/**
+ * The default instance over an mmap'd heap can hold blocks larger than the static heap.
+ */
+START_TEST(heap_mmap_default)
+{
+    const size_t arr[] = {16, 4 * HEAP_SIZE_BYTES};
+    ck_assert(pool_init_heap(NULL, 16 * HEAP_SIZE_BYTES, arr, 2));
+
+    uint8_t* big = pool_alloc(4 * HEAP_SIZE_BYTES);
+    ck_assert(big != NULL);
+    big[4 * HEAP_SIZE_BYTES - 1] = 0xFF;
+
+    uint8_t* small = pool_alloc(16);
+    ck_assert(small != NULL);
+
+    pool_free(big);
+    ck_assert_ptr_eq(pool_alloc(3 * HEAP_SIZE_BYTES), big);
+
+    // Can't initialize the default instance twice
+    ck_assert(!pool_init(arr, 1));
+}
+END_TEST
+
+/**
+ * Heaps too small to hold the pool headers are rejected.
+ */
+START_TEST(heap_too_small)
+{
+    uint8_t buffer[64];
+    const size_t arr[] = {8, 16, 24};
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(buffer, sizeof(buffer));
+    ck_assert(allocator != NULL);
+    ck_assert(!pool_allocator_init(allocator, arr, 3));
+    pool_allocator_destroy(allocator);
+
+    ck_assert(pool_allocator_create_heap(buffer, 0) == NULL);
+}
+END_TEST
+
+/**
+ * Filling an mmap'd multi-gigabyte heap, where pool offsets no longer fit in 32 bits.
+ */
+START_TEST(heap_multi_gigabyte)
+{
+#if SIZE_MAX > UINT32_MAX
+    const size_t heap_size = (size_t)6 << 30;
+    const size_t arr[] = {(size_t)1 << 20, (size_t)4 << 20};
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, heap_size);
+    ck_assert(allocator != NULL);
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    size_t pool_size = heap_pool_size_bytes(heap_size, 2);
+    uint8_t* big_first = NULL;
+    uint8_t* big_last = NULL;
+    size_t big_count = fill_allocator_pool(allocator, arr[1], &big_first, &big_last);
+    ck_assert_msg(big_count == (heap_size - 2 * sizeof(pool_header_t) - pool_size) / arr[1],
+                  "Found %zu blocks", big_count);
+
+    uint8_t* small_first = NULL;
+    size_t small_count = fill_allocator_pool(allocator, arr[0], &small_first, NULL);
+    ck_assert_msg(small_count == pool_size / arr[0], "Found %zu blocks", small_count);
+
+    // Pointer-to-pool lookups work well past 4 GB into the heap
+    ck_assert((size_t)(big_last - small_first) > UINT32_MAX);
+    pool_allocator_free(allocator, big_last);
+    ck_assert(pool_allocator_alloc(allocator, arr[0]) == big_last);
+
+    pool_allocator_destroy(allocator);
+#endif
+}
+END_TEST
+
+/**
+ * Lazily initialized pools hand out fresh blocks without writing them, and only move their frontier one block
+ * at a time once their free list runs dry.
+ */
+START_TEST(heap_lazy_frontier)
+{
+    if (!LAZY_INIT || !POOL_STATS)
+    {
+        return;
+    }
+
+    const size_t heap_size = HEAP_SIZE_BYTES;
+    const size_t arr[] = {32, 256};
+    uint8_t* buffer = malloc(heap_size);
+    memset(buffer, 0xAB, heap_size);
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(buffer, heap_size);
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    pool_stats_t stats;
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.initialized[0] == 0 && stats.initialized[1] == 0);
+
+    uint8_t* blocks[4];
+    for (size_t i = 0; i < 4; i++)
+    {
+        blocks[i] = pool_allocator_alloc_class(allocator, 0);
+        ck_assert_ptr_nonnull(blocks[i]);
+        for (size_t j = 0; j < arr[0]; j++)
+        {
+            ck_assert_msg(blocks[i][j] == 0xAB, "Fresh block %zu was written at byte %zu", i, j);
+        }
+        ck_assert(pool_allocator_get_stats(allocator, &stats));
+        ck_assert_msg(stats.initialized[0] == i + 1, "Frontier at %zu after %zu allocations",
+                      stats.initialized[0], i + 1);
+    }
+    ck_assert(stats.initialized[1] == 0);
+
+    // Freed blocks are handed out again before the frontier moves
+    pool_allocator_free(allocator, blocks[1]);
+    pool_allocator_free(allocator, blocks[2]);
+    uint8_t* reused[2] = {pool_allocator_alloc_class(allocator, 0), pool_allocator_alloc_class(allocator, 0)};
+    ck_assert((reused[0] == blocks[1] && reused[1] == blocks[2]) ||
+              (reused[0] == blocks[2] && reused[1] == blocks[1]));
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.initialized[0] == 4);
+
+    uint8_t* fresh = pool_allocator_alloc(allocator, arr[0]);
+    ck_assert_ptr_nonnull(fresh);
+    for (size_t j = 0; j < arr[0]; j++)
+    {
+        ck_assert(fresh[j] == 0xAB);
+    }
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.initialized[0] == 5);
+
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+// ================= THREAD CACHE TESTS =====================
+
+#define NUM_THREADS 4
+#define THREAD_ITERATIONS 20000
+#define THREAD_LIVE_BLOCKS 64
+
+static const size_t thread_block_sizes[] = {8, 24, 64, 256, 1024};
+
+static void* thread_cache_worker(void* arg)
+{
+    pool_allocator_t* allocator = arg;
+    uint8_t* live[THREAD_LIVE_BLOCKS] = {NULL};
+    size_t live_sizes[THREAD_LIVE_BLOCKS] = {0};
+    uint8_t tag = (uint8_t)(uintptr_t)pthread_self();
+    unsigned int seed = (unsigned int)(uintptr_t)&live;
+    size_t corrupted = 0;
+
+    for (int i = 0; i < THREAD_ITERATIONS; i++)
+    {
+        int slot = rand_r(&seed) % THREAD_LIVE_BLOCKS;
+        if (live[slot] != NULL)
+        {
+            // Nobody else may have touched a block while we held it
+            for (size_t b = 0; b < live_sizes[slot]; b++)
+            {
+                corrupted += live[slot][b] != (uint8_t)(tag + slot);
+            }
+            pool_allocator_free(allocator, live[slot]);
+            live[slot] = NULL;
+        }
+        else
+        {
+            size_t n = thread_block_sizes[rand_r(&seed) % 5];
+            live[slot] = pool_allocator_alloc(allocator, n);
+            if (live[slot] != NULL)
+            {
+                memset(live[slot], (uint8_t)(tag + slot), n);
+                live_sizes[slot] = n;
+            }
+        }
+    }
+
+    for (int slot = 0; slot < THREAD_LIVE_BLOCKS; slot++)
+    {
+        pool_allocator_free(allocator, live[slot]);
+    }
+
+    return (void*)corrupted;
+}
+
+static void* thread_cache_alloc_one(void* arg)
+{
+    pool_allocator_t* allocator = arg;
+    return pool_allocator_alloc(allocator, thread_block_sizes[0]);
+}
+
+/**
+ * A freed block is handed straight back to the same thread.
+ */
+START_TEST(tcache_reuse)
+{
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, thread_block_sizes, 5));
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+    ck_assert(!pool_allocator_enable_thread_cache(allocator));
+
+    uint8_t* a = pool_allocator_alloc(allocator, 8);
+    uint8_t* b = pool_allocator_alloc(allocator, 8);
+    ck_assert(a != NULL && b != NULL && a != b);
+
+    pool_allocator_free(allocator, a);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, 8), a);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Several threads hammering one instance never share a live block, and every block
+ * finds its way back to the shared pools once the threads exit.
+ */
+START_TEST(tcache_threads)
+{
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, thread_block_sizes, 5));
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+
+    pthread_t threads[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        ck_assert(pthread_create(&threads[t], NULL, thread_cache_worker, allocator) == 0);
+    }
+
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        void* corrupted;
+        pthread_join(threads[t], &corrupted);
+        ck_assert_msg(corrupted == NULL, "%zu corrupted bytes", (size_t)corrupted);
+    }
+
+    // Compare against a pristine instance, filling from the largest pool down
+    pool_allocator_t* pristine = pool_allocator_create();
+    ck_assert(pool_allocator_init(pristine, thread_block_sizes, 5));
+
+    for (int b = 4; b >= 0; b--)
+    {
+        size_t expected = fill_allocator_pool(pristine, thread_block_sizes[b], NULL, NULL);
+        size_t found = fill_allocator_pool(allocator, thread_block_sizes[b], NULL, NULL);
+        ck_assert_msg(found == expected, "Pool %d: expecting %zu found %zu", b, expected, found);
+    }
+
+    pool_allocator_destroy(pristine);
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Classes with no cache capacity go straight back to the shared pool.
+ */
+START_TEST(tcache_capacity)
+{
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, thread_block_sizes, 5));
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+    ck_assert(pool_allocator_set_cache_capacity(allocator, 0, 0));
+    ck_assert(!pool_allocator_set_cache_capacity(allocator, 5, 0));
+
+    uint8_t* a = pool_allocator_alloc(allocator, 8);
+    ck_assert(a != NULL);
+    pool_allocator_free(allocator, a);
+
+    pthread_t thread;
+    void* b;
+    pthread_create(&thread, NULL, thread_cache_alloc_one, allocator);
+    pthread_join(thread, &b);
+    ck_assert_ptr_eq(b, a);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Flushing a thread's cache makes its blocks available to other threads.
+ */
+START_TEST(tcache_flush)
+{
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, thread_block_sizes, 5));
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+    ck_assert(pool_allocator_set_cache_capacity(allocator, 0, 1));
+
+    uint8_t* a = pool_allocator_alloc(allocator, 8);
+    ck_assert(a != NULL);
+    pool_allocator_free(allocator, a);
+
+    // Still cached by this thread
+    pthread_t thread;
+    void* b;
+    pthread_create(&thread, NULL, thread_cache_alloc_one, allocator);
+    pthread_join(thread, &b);
+    ck_assert(b != NULL && b != a);
+
+    pool_allocator_flush_thread_cache(allocator);
+
+    pthread_create(&thread, NULL, thread_cache_alloc_one, allocator);
+    pthread_join(thread, &b);
+    ck_assert_ptr_eq(b, a);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= LOCK-FREE POOL TESTS =====================
+
+#define STRESS_BLOCK_SIZE 64
+#define STRESS_HEAP_SIZE (STRESS_BLOCK_SIZE * 128)
+
+typedef struct stress_context
+{
+    pool_allocator_t* allocator;
+    uint8_t* heap;
+    int owners[STRESS_HEAP_SIZE / STRESS_BLOCK_SIZE];
+    size_t duplicated;
+} stress_context_t;
+
+static void* lock_free_worker(void* arg)
+{
+    stress_context_t* ctx = arg;
+    int self = (int)(uintptr_t)pthread_self() | 1;
+    uint8_t* live[8] = {NULL};
+
+    for (int i = 0; i < THREAD_ITERATIONS * 4; i++)
+    {
+        int slot = i % 8;
+        if (live[slot] != NULL)
+        {
+            int* owner = &ctx->owners[(live[slot] - ctx->heap) / STRESS_BLOCK_SIZE];
+            __atomic_store_n(owner, 0, __ATOMIC_RELAXED);
+            pool_allocator_free(ctx->allocator, live[slot]);
+        }
+
+        // Every block handed out must be owned by nobody else
+        live[slot] = pool_allocator_alloc(ctx->allocator, STRESS_BLOCK_SIZE);
+        if (live[slot] != NULL)
+        {
+            int expected = 0;
+            int* owner = &ctx->owners[(live[slot] - ctx->heap) / STRESS_BLOCK_SIZE];
+            if (!__atomic_compare_exchange_n(owner, &expected, self, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                __atomic_add_fetch(&ctx->duplicated, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    for (int slot = 0; slot < 8; slot++)
+    {
+        if (live[slot] != NULL)
+        {
+            __atomic_store_n(&ctx->owners[(live[slot] - ctx->heap) / STRESS_BLOCK_SIZE], 0, __ATOMIC_RELAXED);
+            pool_allocator_free(ctx->allocator, live[slot]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Many threads popping and pushing one pool's free list without a lock (or thread cache)
+ * never hand out the same block twice, and never lose one.
+ */
+START_TEST(lock_free_stress)
+{
+    // Without LOCK_FREE the shared pools aren't thread-safe on their own
+    if (!LOCK_FREE)
+    {
+        return;
+    }
+
+    const size_t arr[] = {STRESS_BLOCK_SIZE};
+    stress_context_t* ctx = calloc(1, sizeof(stress_context_t));
+    ctx->heap = malloc(STRESS_HEAP_SIZE);
+    ctx->allocator = pool_allocator_create_heap(ctx->heap, STRESS_HEAP_SIZE);
+    ck_assert(pool_allocator_init(ctx->allocator, arr, 1));
+
+    pthread_t threads[NUM_THREADS * 2];
+    for (int t = 0; t < NUM_THREADS * 2; t++)
+    {
+        ck_assert(pthread_create(&threads[t], NULL, lock_free_worker, ctx) == 0);
+    }
+
+    for (int t = 0; t < NUM_THREADS * 2; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    ck_assert_msg(ctx->duplicated == 0, "%zu blocks handed out twice", ctx->duplicated);
+
+    // Every block is back on the free list exactly once
+    size_t expected = (STRESS_HEAP_SIZE - sizeof(pool_header_t)) / STRESS_BLOCK_SIZE;
+    size_t found = fill_allocator_pool(ctx->allocator, STRESS_BLOCK_SIZE, NULL, NULL);
+    ck_assert_msg(found == expected, "Expecting %zu blocks found %zu", expected, found);
+
+    pool_allocator_destroy(ctx->allocator);
+    free(ctx->heap);
+    free(ctx);
+}
+END_TEST
+
+static void* bulk_worker(void* arg)
+{
+    stress_context_t* ctx = arg;
+    int self = (int)(uintptr_t)pthread_self() | 1;
+    void* ptrs[8];
+
+    for (int i = 0; i < THREAD_ITERATIONS; i++)
+    {
+        // Every block handed out must be owned by nobody else
+        size_t count = pool_allocator_alloc_bulk(ctx->allocator, STRESS_BLOCK_SIZE, 1 + i % 8, ptrs);
+        for (size_t j = 0; j < count; j++)
+        {
+            int expected = 0;
+            int* owner = &ctx->owners[((uint8_t*)ptrs[j] - ctx->heap) / STRESS_BLOCK_SIZE];
+            if (!__atomic_compare_exchange_n(owner, &expected, self, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                __atomic_add_fetch(&ctx->duplicated, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        for (size_t j = 0; j < count; j++)
+        {
+            __atomic_store_n(&ctx->owners[((uint8_t*)ptrs[j] - ctx->heap) / STRESS_BLOCK_SIZE], 0, __ATOMIC_RELAXED);
+        }
+        pool_allocator_free_bulk(ctx->allocator, ptrs, count);
+    }
+
+    return NULL;
+}
+
+/**
+ * Bulk allocations detaching whole chains race single-block allocations and frees safely.
+ */
+START_TEST(lock_free_bulk_stress)
+{
+    // Without LOCK_FREE the shared pools aren't thread-safe on their own
+    if (!LOCK_FREE)
+    {
+        return;
+    }
+
+    const size_t arr[] = {STRESS_BLOCK_SIZE};
+    stress_context_t* ctx = calloc(1, sizeof(stress_context_t));
+    ctx->heap = malloc(STRESS_HEAP_SIZE);
+    ctx->allocator = pool_allocator_create_heap(ctx->heap, STRESS_HEAP_SIZE);
+    ck_assert(pool_allocator_init(ctx->allocator, arr, 1));
+
+    pthread_t threads[NUM_THREADS * 2];
+    for (int t = 0; t < NUM_THREADS * 2; t++)
+    {
+        ck_assert(pthread_create(&threads[t], NULL, t % 2 ? bulk_worker : lock_free_worker, ctx) == 0);
+    }
+
+    for (int t = 0; t < NUM_THREADS * 2; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    ck_assert_msg(ctx->duplicated == 0, "%zu blocks handed out twice", ctx->duplicated);
+
+    size_t expected = (STRESS_HEAP_SIZE - sizeof(pool_header_t)) / STRESS_BLOCK_SIZE;
+    size_t found = fill_allocator_pool(ctx->allocator, STRESS_BLOCK_SIZE, NULL, NULL);
+    ck_assert_msg(found == expected, "Expecting %zu blocks found %zu", expected, found);
+
+    pool_allocator_destroy(ctx->allocator);
+    free(ctx->heap);
+    free(ctx);
+}
+END_TEST
+
+static void* lazy_init_worker(void* arg)
+{
+    stress_context_t* ctx = arg;
+    size_t count = 0;
+    uint8_t* ptr;
+
+    while ((ptr = pool_allocator_alloc(ctx->allocator, STRESS_BLOCK_SIZE)) != NULL)
+    {
+        if (__atomic_add_fetch(&ctx->owners[(ptr - ctx->heap) / STRESS_BLOCK_SIZE], 1, __ATOMIC_RELAXED) != 1)
+        {
+            __atomic_add_fetch(&ctx->duplicated, 1, __ATOMIC_RELAXED);
+        }
+        count++;
+    }
+
+    return (void*)count;
+}
+
+/**
+ * Concurrent lazy initialization hands out every block of a fresh pool exactly once.
+ */
+START_TEST(lock_free_lazy_init)
+{
+    // Without LOCK_FREE the shared pools aren't thread-safe on their own
+    if (!LOCK_FREE)
+    {
+        return;
+    }
+
+    const size_t arr[] = {STRESS_BLOCK_SIZE};
+    stress_context_t* ctx = calloc(1, sizeof(stress_context_t));
+    ctx->heap = malloc(STRESS_HEAP_SIZE);
+    ctx->allocator = pool_allocator_create_heap(ctx->heap, STRESS_HEAP_SIZE);
+    ck_assert(pool_allocator_init(ctx->allocator, arr, 1));
+
+    // Each thread grabs blocks until the pool is exhausted, without freeing any
+    pthread_t threads[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        ck_assert(pthread_create(&threads[t], NULL, lazy_init_worker, ctx) == 0);
+    }
+
+    size_t total = 0;
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        void* count;
+        pthread_join(threads[t], &count);
+        total += (size_t)count;
+    }
+
+    ck_assert_msg(ctx->duplicated == 0, "%zu blocks handed out twice", ctx->duplicated);
+    ck_assert(total == (STRESS_HEAP_SIZE - sizeof(pool_header_t)) / STRESS_BLOCK_SIZE);
+
+    pool_allocator_destroy(ctx->allocator);
+    free(ctx->heap);
+    free(ctx);
+}
+END_TEST
+
+// ================= POOL LAYOUT TESTS =====================
+
+/**
+ * The even layout reports its headers and leaves no more than alignment rounding unused.
+ */
+START_TEST(layout_even_info)
+{
+    const size_t arr[] = {8, 64, 4096};
+    pool_allocator_t* allocator = pool_allocator_create();
+    pool_layout_info_t info;
+    ck_assert(!pool_allocator_layout_info(allocator, &info));
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+
+    ck_assert(info.layout == POOL_LAYOUT_EVEN);
+    ck_assert(info.pool_span == (size_t)pool_size_bytes(3));
+    ck_assert(info.header_bytes == 3 * sizeof(pool_header_t));
+    ck_assert(info.padding_bytes < 3 * sizeof(void*));
+
+    // Whatever doesn't divide evenly into blocks at the end of each pool is slack
+    size_t usable = HEAP_SIZE_BYTES - info.header_bytes - info.padding_bytes;
+    size_t slack = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        slack += MIN(info.pool_span, usable - i * info.pool_span) % arr[i];
+    }
+    ck_assert_msg(info.slack_bytes == slack, "Expecting %zu slack bytes found %zu", slack, info.slack_bytes);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Check that the first and last block of every evenly laid out pool map back to their own pool,
+ * and the byte before each pool's first block to the pool before it.
+ */
+static void check_pool_boundaries(pool_allocator_t* allocator, const size_t* arr, int num_pools, size_t heap_size)
+{
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    size_t usable = heap_size - info.header_bytes - info.padding_bytes;
+
+    uint8_t* base = NULL;
+    for (int i = 0; i < num_pools; i++)
+    {
+        // Fresh blocks come off the start of their pool
+        uint8_t* first = pool_allocator_alloc_class(allocator, i);
+        ck_assert_ptr_nonnull(first);
+        base = i == 0 ? first : base;
+        ck_assert((size_t)(first - base) == i * info.pool_span);
+
+        uint8_t* last = first + (MIN(info.pool_span, usable - i * info.pool_span) / arr[i] - 1) * arr[i];
+        ck_assert(pool_allocator_usable_size(allocator, first) == arr[i]);
+        ck_assert_msg(pool_allocator_usable_size(allocator, last) == arr[i], "Pool %d's last block", i);
+        ck_assert(i == 0 || pool_allocator_usable_size(allocator, first - 1) == arr[i - 1]);
+    }
+}
+
+/**
+ * Pointers resolve to their pool by multiplying with the reciprocal of the pool span, and by dividing
+ * on heaps too large for the reciprocal to be exact. Pool heads each get cache lines of their own.
+ */
+START_TEST(layout_pointer_lookup)
+{
+    ck_assert(_Alignof(pool_head_t) == CACHE_LINE_SIZE && sizeof(pool_head_t) % CACHE_LINE_SIZE == 0);
+
+    const size_t arr[] = {24, 200, 1000};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+    check_pool_boundaries(allocator, arr, 3, HEAP_SIZE_BYTES);
+    pool_allocator_destroy(allocator);
+
+    // Past 4 GB the offsets are divided instead. Only the pages touched here are ever backed.
+    if (sizeof(size_t) == 8)
+    {
+        const size_t large_heap = ((size_t)5 << 30) + 1000;
+        const size_t large[] = {64, 4096, 1 << 20};
+        allocator = pool_allocator_create_heap(NULL, large_heap);
+        ck_assert_ptr_nonnull(allocator);
+        ck_assert(pool_allocator_init(allocator, large, 3));
+        check_pool_boundaries(allocator, large, 3, large_heap);
+        pool_allocator_destroy(allocator);
+    }
+}
+END_TEST
+
+/**
+ * Power of two layouts align every pool to its span and find pools by shifting.
+ */
+START_TEST(layout_pow2_pools)
+{
+    const size_t heap_size = 4 * HEAP_SIZE_BYTES;
+    const size_t arr[] = {8, 64, 4096};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 3, .layout = POOL_LAYOUT_POW2};
+    uint8_t* buffer = malloc(heap_size);
+    pool_allocator_t* allocator = pool_allocator_create_heap(buffer, heap_size);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.layout == POOL_LAYOUT_POW2);
+    ck_assert((info.pool_span & (info.pool_span - 1)) == 0);
+    ck_assert(info.pool_span * 2 > heap_size / 3 - info.padding_bytes);
+    ck_assert(info.header_bytes == 0);
+    ck_assert(info.padding_bytes + 3 * info.pool_span == heap_size);
+
+    // Fill backwards so smaller blocks don't spill into the larger pools
+    for (int i = 2; i >= 0; i--)
+    {
+        uint8_t* first = NULL;
+        uint8_t* last = NULL;
+        size_t count = fill_allocator_pool(allocator, arr[i], &first, &last);
+        ck_assert(count == info.pool_span / arr[i]);
+        ck_assert(((uintptr_t)first & (info.pool_span - 1)) == 0);
+        ck_assert((uintptr_t)first / info.pool_span == (uintptr_t)last / info.pool_span);
+
+        pool_allocator_free(allocator, last);
+        ck_assert_ptr_eq(pool_allocator_alloc(allocator, arr[i]), last);
+    }
+
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+/**
+ * Power of two layouts fall back to a smaller span when aligning the first pool
+ * wouldn't leave room for the rest, and reject unknown layouts.
+ */
+START_TEST(layout_pow2_unaligned)
+{
+    const size_t arr[] = {8, 64};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_POW2};
+    uint8_t* buffer = malloc(HEAP_SIZE_BYTES + 64);
+
+    // A heap that isn't 32 KB aligned can't hold two aligned 32 KB pools
+    uint8_t* heap = (uint8_t*)aligned((uintptr_t)buffer, 64) + 8;
+    pool_allocator_t* allocator = pool_allocator_create_heap(heap, HEAP_SIZE_BYTES);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.pool_span == HEAP_SIZE_BYTES / 4);
+    ck_assert(info.padding_bytes == HEAP_SIZE_BYTES / 2);
+    ck_assert(fill_allocator_pool(allocator, 8, NULL, NULL) == info.pool_span / 8 + info.pool_span / 64);
+    pool_allocator_destroy(allocator);
+
+    config.layout = (pool_layout_t)42;
+    allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    ck_assert(!pool_allocator_init_ex(allocator, NULL));
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+/**
+ * Weighted capacities split the heap in proportion, and blocks find their way back to the right pool.
+ */
+START_TEST(layout_weighted_capacity)
+{
+    const size_t arr[] = {8, 64, 4096};
+    const size_t weights[] = {6, 1, 1};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 3,
+                            .capacity = POOL_CAPACITY_WEIGHTS, .capacities = weights};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+
+    size_t available = HEAP_SIZE_BYTES - 3 * sizeof(pool_header_t);
+    size_t used = 0;
+    for (int i = 2; i >= 0; i--)
+    {
+        size_t bytes = (size_t)((double)available * weights[i] / 8) & ~(sizeof(void*) - 1);
+        used += bytes;
+
+        uint8_t* first = NULL;
+        uint8_t* last = NULL;
+        size_t count = fill_allocator_pool(allocator, arr[i], &first, &last);
+        ck_assert_msg(count == bytes / arr[i], "Expecting %zu blocks found %zu", bytes / arr[i], count);
+
+        // Frees find the pool through the prefix-offset table
+        pool_allocator_free(allocator, first);
+        ck_assert_ptr_eq(pool_allocator_alloc(allocator, arr[i]), first);
+        pool_allocator_free(allocator, last);
+        ck_assert_ptr_eq(pool_allocator_alloc(allocator, arr[i]), last);
+    }
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.pool_span == 0);
+    ck_assert(info.padding_bytes == available - used);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Block counts and byte budgets size pools exactly, reporting whatever they leave over.
+ */
+START_TEST(layout_block_counts)
+{
+    const size_t arr[] = {8, 64, 4096};
+    const size_t counts[] = {100, 10, 1};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 3,
+                            .capacity = POOL_CAPACITY_BLOCKS, .capacities = counts};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+
+    for (int i = 2; i >= 0; i--)
+    {
+        ck_assert(fill_allocator_pool(allocator, arr[i], NULL, NULL) == counts[i]);
+    }
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.slack_bytes == 0);
+    ck_assert(info.padding_bytes == HEAP_SIZE_BYTES - 3 * sizeof(pool_header_t) - (800 + 640 + 4096));
+    pool_allocator_destroy(allocator);
+
+    // Budgets that are too big to fit, or too small for a single block, are rejected
+    const size_t budgets[] = {HEAP_SIZE_BYTES / 2, HEAP_SIZE_BYTES / 2, 4096};
+    const size_t tiny[] = {4096, 32, 4096};
+    const size_t none[] = {100, 0, 1};
+    config.capacity = POOL_CAPACITY_BYTES;
+    config.capacities = budgets;
+    allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    config.capacities = tiny;
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    config.capacity = POOL_CAPACITY_BLOCKS;
+    config.capacities = none;
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    config.capacities = NULL;
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    config.capacities = counts;
+    config.layout = POOL_LAYOUT_POW2;
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    config.layout = POOL_LAYOUT_EVEN;
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Count the spans of an instance laid out with POOL_LAYOUT_SPANS.
+ */
+static size_t span_count(pool_allocator_t* allocator, size_t heap_size)
+{
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.layout == POOL_LAYOUT_SPANS && info.pool_span == SPAN_SIZE_BYTES);
+
+    return (heap_size - info.header_bytes - info.padding_bytes) / SPAN_SIZE_BYTES;
+}
+
+/**
+ * Spans go to whichever pool needs them, and come back once all their blocks are freed.
+ */
+START_TEST(layout_spans_rebalance)
+{
+    const size_t arr[] = {64, 256};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    size_t num_spans = span_count(allocator, HEAP_SIZE_BYTES);
+    ck_assert(num_spans >= 8);
+
+    // A burst of small blocks takes the whole heap
+    size_t count = 0;
+    uint8_t* ptrs[HEAP_SIZE_BYTES / 64];
+    while ((ptrs[count] = pool_allocator_alloc_class(allocator, 0)) != NULL)
+    {
+        count++;
+    }
+    ck_assert_msg(count == num_spans * (SPAN_SIZE_BYTES / arr[0]), "Found %zu blocks", count);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) == NULL);
+    ck_assert(pool_allocator_alloc(allocator, arr[1]) == NULL);
+
+    // Freed blocks go back to their pool until a larger class starves and reclaims them
+    for (size_t i = 0; i < count; i++)
+    {
+        pool_allocator_free(allocator, ptrs[i]);
+    }
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, arr[0]), ptrs[count - 1]);
+    pool_allocator_free_sized(allocator, ptrs[count - 1], arr[0]);
+
+    count = 0;
+    while ((ptrs[count] = pool_allocator_alloc(allocator, arr[1])) != NULL)
+    {
+        ck_assert(pool_allocator_size_class(allocator, arr[1]) == 1);
+        count++;
+    }
+    ck_assert_msg(count == num_spans * (SPAN_SIZE_BYTES / arr[1]), "Found %zu blocks", count);
+    ck_assert(pool_allocator_alloc(allocator, arr[0]) == NULL);
+
+    // And back again, spilling nothing into the larger class
+    for (size_t i = 0; i < count; i++)
+    {
+        pool_allocator_free_class(allocator, ptrs[i], 1);
+    }
+    count = 0;
+    while ((ptrs[count] = pool_allocator_alloc(allocator, arr[0])) != NULL)
+    {
+        count++;
+    }
+    ck_assert(count == num_spans * (SPAN_SIZE_BYTES / arr[0]));
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.slack_bytes == 0);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Spans with any live block stay with their pool, blocks in thread caches included.
+ */
+START_TEST(layout_spans_partial)
+{
+    const size_t arr[] = {24, 4096};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_reclaim_spans(allocator) == 0);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    size_t num_spans = span_count(allocator, HEAP_SIZE_BYTES);
+    size_t per_span = SPAN_SIZE_BYTES / arr[0];
+
+    uint8_t* ptrs[HEAP_SIZE_BYTES / 24];
+    size_t count = 0;
+    while ((ptrs[count] = pool_allocator_alloc(allocator, arr[0])) != NULL)
+    {
+        count++;
+    }
+    ck_assert(count == num_spans * per_span);
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.slack_bytes == num_spans * (SPAN_SIZE_BYTES % arr[0]));
+
+    // Keep one block alive in the first span, and cache another block of the second span
+    for (size_t i = 1; i < count; i++)
+    {
+        pool_allocator_free(allocator, ptrs[i]);
+    }
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+    void* cached = pool_allocator_alloc(allocator, arr[0]);
+    ck_assert(cached != NULL);
+    pool_allocator_free(allocator, cached);
+
+    ck_assert(pool_allocator_reclaim_spans(allocator) == num_spans - 2);
+    ck_assert(pool_allocator_reclaim_spans(allocator) == 0);
+    size_t large = 0;
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+        large++;
+    }
+    ck_assert(large == num_spans - 2);
+
+    // Flushing the cache frees up the second span too
+    pool_allocator_flush_thread_cache(allocator);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) != NULL);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) == NULL);
+    pool_allocator_free(allocator, ptrs[0]);
+    pool_allocator_flush_thread_cache(allocator);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) != NULL);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Span layouts need blocks that fit a span, even capacities and room for at least one span.
+ */
+START_TEST(layout_spans_invalid)
+{
+    const size_t arr[] = {8, SPAN_SIZE_BYTES + 8};
+    const size_t counts[] = {1, 1};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    config.block_size_count = 1;
+    config.capacity = POOL_CAPACITY_BLOCKS;
+    config.capacities = counts;
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    config.capacity = POOL_CAPACITY_EVEN;
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+
+    uint8_t* buffer = malloc(SPAN_SIZE_BYTES);
+    allocator = pool_allocator_create_heap(buffer, SPAN_SIZE_BYTES);
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+#define SPANS_HEAP_SIZE (SPAN_SIZE_BYTES * 10)
+#define SPANS_SLOTS 16
+
+typedef struct spans_context
+{
+    pool_allocator_t* allocator;
+    uint8_t* heap;
+    int owners[SPANS_HEAP_SIZE / STRESS_BLOCK_SIZE];
+    size_t duplicated;
+} spans_context_t;
+
+static void* spans_worker(void* arg)
+{
+    spans_context_t* ctx = arg;
+    int self = (int)(uintptr_t)pthread_self() | 1;
+    uint8_t* live[SPANS_SLOTS] = {NULL};
+    size_t sizes[SPANS_SLOTS];
+
+    for (int i = 0; i < THREAD_ITERATIONS; i++)
+    {
+        int slot = i % SPANS_SLOTS;
+        if (live[slot] != NULL)
+        {
+            for (size_t j = 0; j < sizes[slot] / STRESS_BLOCK_SIZE; j++)
+            {
+                __atomic_store_n(&ctx->owners[(live[slot] - ctx->heap) / STRESS_BLOCK_SIZE + j], 0, __ATOMIC_RELAXED);
+            }
+            pool_allocator_free(ctx->allocator, live[slot]);
+        }
+
+        // Alternate bursts of small and large blocks, so spans keep changing pools,
+        // and every byte handed out must be owned by nobody else
+        sizes[slot] = (i / 256) % 2 ? 8 * STRESS_BLOCK_SIZE : 32 * STRESS_BLOCK_SIZE;
+        live[slot] = pool_allocator_alloc(ctx->allocator, sizes[slot]);
+        for (size_t j = 0; live[slot] != NULL && j < sizes[slot] / STRESS_BLOCK_SIZE; j++)
+        {
+            int expected = 0;
+            int* owner = &ctx->owners[(live[slot] - ctx->heap) / STRESS_BLOCK_SIZE + j];
+            if (!__atomic_compare_exchange_n(owner, &expected, self, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                __atomic_add_fetch(&ctx->duplicated, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    for (int slot = 0; slot < SPANS_SLOTS; slot++)
+    {
+        for (size_t j = 0; live[slot] != NULL && j < sizes[slot] / STRESS_BLOCK_SIZE; j++)
+        {
+            __atomic_store_n(&ctx->owners[(live[slot] - ctx->heap) / STRESS_BLOCK_SIZE + j], 0, __ATOMIC_RELAXED);
+        }
+        pool_allocator_free(ctx->allocator, live[slot]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Threads moving spans between pools never hand out overlapping blocks, and never lose a span.
+ */
+START_TEST(layout_spans_threads)
+{
+    // Without LOCK_FREE the shared pools aren't thread-safe on their own
+    if (!LOCK_FREE)
+    {
+        return;
+    }
+
+    const size_t arr[] = {8 * STRESS_BLOCK_SIZE, 32 * STRESS_BLOCK_SIZE};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    spans_context_t* ctx = calloc(1, sizeof(spans_context_t));
+    ctx->heap = malloc(SPANS_HEAP_SIZE);
+    ctx->allocator = pool_allocator_create_heap(ctx->heap, SPANS_HEAP_SIZE);
+    ck_assert(pool_allocator_init_ex(ctx->allocator, &config));
+    size_t num_spans = span_count(ctx->allocator, SPANS_HEAP_SIZE);
+
+    pthread_t threads[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        ck_assert(pthread_create(&threads[t], NULL, spans_worker, ctx) == 0);
+    }
+
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    ck_assert_msg(ctx->duplicated == 0, "%zu blocks handed out twice", ctx->duplicated);
+
+    // Every span is fully free again, so the large class can take them all
+    pool_allocator_reclaim_spans(ctx->allocator);
+    size_t found = 0;
+    while (pool_allocator_alloc_class(ctx->allocator, 1) != NULL)
+    {
+        found++;
+    }
+    ck_assert_msg(found == num_spans * (SPAN_SIZE_BYTES / arr[1]), "Found %zu blocks", found);
+
+    pool_allocator_destroy(ctx->allocator);
+    free(ctx->heap);
+    free(ctx);
+}
+END_TEST
+
+/**
+ * Pool tails too short for another of their own blocks become blocks of the smallest class,
+ * and those blocks go back to it however they're freed.
+ */
+START_TEST(layout_fill_slack)
+{
+    const size_t arr[] = {16, 100, 1000};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 3};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    pool_layout_info_t plain;
+    ck_assert(pool_allocator_layout_info(allocator, &plain));
+    ck_assert(plain.recovered_bytes == 0);
+    size_t small_blocks = 0, large_blocks = 0;
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+        small_blocks++;
+    }
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+        large_blocks++;
+    }
+    pool_allocator_destroy(allocator);
+
+    config.fill_slack = true;
+    allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.recovered_bytes > 0 && info.recovered_bytes % arr[0] == 0);
+    ck_assert(info.slack_bytes + info.recovered_bytes == plain.slack_bytes);
+
+    // The smallest class holds its own blocks plus the recovered ones
+    size_t expected = small_blocks + info.recovered_bytes / arr[0];
+    uint8_t** ptrs = malloc(expected * sizeof(uint8_t*));
+    uint8_t* tail = NULL;
+    for (size_t i = 0; i < expected; i++)
+    {
+        ptrs[i] = pool_allocator_alloc_class(allocator, 0);
+        ck_assert_ptr_nonnull(ptrs[i]);
+        tail = ptrs[i] > tail ? ptrs[i] : tail;
+    }
+    ck_assert_ptr_null(pool_allocator_alloc_class(allocator, 0));
+
+    // The highest block sits in the last pool's tail, and goes back to the smallest class however it's freed
+    pool_allocator_free(allocator, tail);
+    ck_assert(pool_allocator_alloc_class(allocator, 0) == tail);
+    pool_allocator_free_sized(allocator, tail, arr[0]);
+    ck_assert(pool_allocator_alloc_class(allocator, 0) == tail);
+    pool_allocator_free_class(allocator, tail, 0);
+    ck_assert(pool_allocator_alloc_class(allocator, 0) == tail);
+
+    // Nothing was taken from the larger classes
+    size_t large = 0;
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+        large++;
+    }
+    ck_assert_msg(large == large_blocks, "Found %zu of %zu large blocks", large, large_blocks);
+
+    pool_allocator_free_bulk(allocator, (void**)ptrs, expected);
+    for (size_t i = 0; i < expected; i++)
+    {
+        ck_assert_ptr_nonnull(pool_allocator_alloc_class(allocator, 0));
+    }
+    ck_assert_ptr_null(pool_allocator_alloc_class(allocator, 0));
+
+    free(ptrs);
+    pool_allocator_destroy(allocator);
+
+    // Spans have no fixed tails to fill
+    config.layout = POOL_LAYOUT_SPANS;
+    allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Compact pools end on their last block and sit back to back, leaving all the slack behind the
+ * last pool, which can then be handed to any class.
+ */
+START_TEST(layout_compact_pools)
+{
+    const size_t arr[] = {24, 100, 1000};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 3, .layout = POOL_LAYOUT_COMPACT};
+    uint8_t* buffer = malloc(HEAP_SIZE_BYTES);
+    pool_allocator_t* allocator = pool_allocator_create_heap(buffer, HEAP_SIZE_BYTES);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.layout == POOL_LAYOUT_COMPACT);
+    ck_assert(info.slack_bytes == 0);
+    ck_assert(info.header_bytes == 3 * sizeof(pool_header_t));
+    ck_assert(info.trailing_bytes == info.padding_bytes && info.trailing_bytes >= arr[0]);
+
+    // Every block of a pool is followed by the next pool's first block
+    uint8_t* last[3] = {NULL, NULL, NULL};
+    uint8_t* first[3] = {NULL, NULL, NULL};
+    size_t counts[3] = {0, 0, 0};
+    for (int i = 0; i < 3; i++)
+    {
+        uint8_t* ptr;
+        while ((ptr = pool_allocator_alloc_class(allocator, i)) != NULL)
+        {
+            first[i] = first[i] == NULL || ptr < first[i] ? ptr : first[i];
+            last[i] = ptr > last[i] ? ptr : last[i];
+            counts[i]++;
+        }
+        ck_assert(last[i] == first[i] + (counts[i] - 1) * aligned(arr[i], sizeof(void*)));
+    }
+    ck_assert(first[1] == last[0] + arr[0]);
+    ck_assert(first[2] == last[1] + aligned(arr[1], sizeof(void*)));
+    ck_assert(last[2] + arr[2] + info.trailing_bytes == buffer + HEAP_SIZE_BYTES);
+
+    // Frees find every pool through the boundary table
+    pool_allocator_free(allocator, first[0]);
+    pool_allocator_free(allocator, last[0]);
+    pool_allocator_free(allocator, first[1]);
+    pool_allocator_free(allocator, last[2]);
+    ck_assert(pool_allocator_alloc_class(allocator, 0) != NULL);
+    ck_assert(pool_allocator_alloc_class(allocator, 0) != NULL);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) == first[1]);
+    ck_assert(pool_allocator_alloc_class(allocator, 2) == last[2]);
+    ck_assert_ptr_null(pool_allocator_alloc_class(allocator, 0));
+
+    // The trailing region becomes more small blocks, which are freed back to the small class
+    size_t given = pool_allocator_give_trailing(allocator, 0);
+    ck_assert(given == info.trailing_bytes / arr[0]);
+    ck_assert(pool_allocator_give_trailing(allocator, 0) == 0);
+    uint8_t* tail = NULL;
+    for (size_t i = 0; i < given; i++)
+    {
+        tail = pool_allocator_alloc_class(allocator, 0);
+        ck_assert(tail > last[2] && tail < buffer + HEAP_SIZE_BYTES);
+    }
+    ck_assert_ptr_null(pool_allocator_alloc_class(allocator, 0));
+    pool_allocator_free(allocator, tail);
+    ck_assert(pool_allocator_alloc_class(allocator, 0) == tail);
+    pool_allocator_free_class(allocator, tail, 0);
+    ck_assert(pool_allocator_alloc(allocator, arr[0]) == tail);
+    pool_allocator_free_sized(allocator, tail, arr[0]);
+    ck_assert(pool_allocator_alloc_class(allocator, 0) == tail);
+
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.trailing_bytes == 0);
+
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+/**
+ * The trailing region can also be bump allocated, and those allocations are left alone by frees.
+ */
+START_TEST(layout_compact_trailing)
+{
+    const size_t arr[] = {64, 4000};
+    const size_t counts[] = {100, 4};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_COMPACT,
+                            .capacity = POOL_CAPACITY_BLOCKS, .capacities = counts};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    size_t available = info.trailing_bytes;
+    ck_assert(available == HEAP_SIZE_BYTES - 2 * sizeof(pool_header_t) - 100 * 64 - 4 * 4000);
+
+    ck_assert_ptr_null(pool_allocator_alloc_trailing(allocator, 0));
+    uint8_t* a = pool_allocator_alloc_trailing(allocator, 10);
+    uint8_t* b = pool_allocator_alloc_trailing(allocator, 10);
+    ck_assert_ptr_nonnull(a);
+    ck_assert(b == a + aligned(10, sizeof(void*)));
+    ck_assert((uintptr_t)a % sizeof(void*) == 0);
+
+    // Freeing a bump allocation doesn't hand it to any pool
+    pool_allocator_free(allocator, a);
+    size_t small = 0;
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+        small++;
+    }
+    ck_assert(small == counts[0]);
+
+    size_t used = 2 * aligned(10, sizeof(void*));
+    ck_assert_ptr_null(pool_allocator_alloc_trailing(allocator, available - used + 1));
+    ck_assert_ptr_nonnull(pool_allocator_alloc_trailing(allocator, available - used));
+    ck_assert_ptr_null(pool_allocator_alloc_trailing(allocator, 1));
+    ck_assert(pool_allocator_give_trailing(allocator, 0) == 0);
+    ck_assert(pool_allocator_give_trailing(allocator, 2) == 0);
+    pool_allocator_destroy(allocator);
+
+    // Spans have no region to spare
+    config.layout = POOL_LAYOUT_SPANS;
+    config.capacity = POOL_CAPACITY_EVEN;
+    allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    ck_assert_ptr_null(pool_allocator_alloc_trailing(allocator, 8));
+    ck_assert(pool_allocator_give_trailing(allocator, 0) == 0);
+    pool_allocator_destroy(allocator);
+
+    // Individually sized pools still can't be laid out in power of two spans
+    config.layout = POOL_LAYOUT_POW2;
+    config.capacity = POOL_CAPACITY_BLOCKS;
+    allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= HEAP GROWTH TESTS =====================
+
+#define GROWTH_HEAP_SIZE (SPAN_SIZE_BYTES * 4)
+
+/**
+ * A growable span heap keeps handing out blocks from new chunks until it hits its limit,
+ * and blocks from every chunk find their way back and move between pools.
+ */
+START_TEST(growth_mmap_chunks)
+{
+    const size_t arr[] = {64, 512};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    pool_growth_t growth = {.chunk_size = GROWTH_HEAP_SIZE, .growth_factor = 2.0,
+                            .max_heap_size = GROWTH_HEAP_SIZE * 4};
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, GROWTH_HEAP_SIZE);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    size_t num_spans = span_count(allocator, GROWTH_HEAP_SIZE);
+
+    size_t count = 0;
+    uint8_t** ptrs = malloc(sizeof(uint8_t*) * (GROWTH_HEAP_SIZE * 4 / arr[0]));
+    while ((ptrs[count] = pool_allocator_alloc_class(allocator, 0)) != NULL)
+    {
+        count++;
+    }
+    ck_assert(count == num_spans * (SPAN_SIZE_BYTES / arr[0]));
+
+    // Chunks of one and then two heaps' worth fill up the limit
+    ck_assert(pool_allocator_set_growth(allocator, &growth));
+    ck_assert(!pool_allocator_set_growth(allocator, &growth));
+    while ((ptrs[count] = pool_allocator_alloc_class(allocator, 0)) != NULL)
+    {
+        ck_assert(pool_allocator_size_class(allocator, arr[0]) == 0);
+        count++;
+    }
+    ck_assert(pool_allocator_alloc(allocator, arr[1]) == NULL);
+    ck_assert(count > 3 * num_spans * (SPAN_SIZE_BYTES / arr[0]));
+    ck_assert(count % (SPAN_SIZE_BYTES / arr[0]) == 0);
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.chunk_count == 2 && info.chunk_bytes == GROWTH_HEAP_SIZE * 3);
+
+    // Foreign pointers are still ignored, and every block goes back to its pool
+    int local;
+    pool_allocator_free(allocator, &local);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i % 2)
+        {
+            pool_allocator_free(allocator, ptrs[i]);
+        }
+        else
+        {
+            pool_allocator_free_sized(allocator, ptrs[i], arr[0]);
+        }
+    }
+
+    // So that the larger class can take every span of the heap and its chunks
+    size_t large = 0;
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+        large++;
+    }
+    ck_assert_msg(large * arr[1] == count * arr[0], "Found %zu blocks", large);
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.chunk_count == 2);
+
+    free(ptrs);
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+typedef struct growth_source
+{
+    size_t sizes[4];
+    size_t allocated;
+    size_t freed;
+    size_t max_chunks;
+} growth_source_t;
+
+static void* growth_chunk_alloc(size_t size, void* context)
+{
+    // Deliberately misaligned, like any caller-provided memory may be
+    growth_source_t* source = context;
+    if (source->allocated == source->max_chunks)
+    {
+        return NULL;
+    }
+
+    void* chunk;
+    ck_assert(posix_memalign(&chunk, SPAN_SIZE_BYTES, size + 3) == 0);
+    source->sizes[source->allocated++] = size;
+    return (uint8_t*)chunk + 3;
+}
+
+static void growth_chunk_free(void* chunk, size_t size, void* context)
+{
+    // Newest first
+    growth_source_t* source = context;
+    source->freed++;
+    ck_assert(size == source->sizes[source->allocated - source->freed]);
+    free((uint8_t*)chunk - 3);
+}
+
+/**
+ * Chunks come from the caller's allocator, grow by the growth factor up to the chunk cap,
+ * and are given back on destroy.
+ */
+START_TEST(growth_callback_limits)
+{
+    const size_t arr[] = {256};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 1, .layout = POOL_LAYOUT_SPANS};
+    growth_source_t source = {.max_chunks = 3};
+    pool_growth_t growth = {.chunk_alloc = growth_chunk_alloc, .chunk_free = growth_chunk_free, .context = &source,
+                            .chunk_size = SPAN_SIZE_BYTES * 3, .growth_factor = 4.0,
+                            .max_chunk_size = SPAN_SIZE_BYTES * 5};
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, GROWTH_HEAP_SIZE);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    ck_assert(pool_allocator_set_growth(allocator, &growth));
+
+    size_t count = 0;
+    while (pool_allocator_alloc(allocator, arr[0]) != NULL)
+    {
+        count++;
+    }
+    ck_assert(source.allocated == 3);
+    ck_assert(source.sizes[0] == SPAN_SIZE_BYTES * 3);
+    ck_assert(source.sizes[1] == SPAN_SIZE_BYTES * 5 && source.sizes[2] == SPAN_SIZE_BYTES * 5);
+
+    // Misaligned chunks lose a span to alignment, plus a little for their descriptors
+    size_t per_span = SPAN_SIZE_BYTES / arr[0];
+    ck_assert_msg(count == (span_count(allocator, GROWTH_HEAP_SIZE) + 2 + 4 + 4) * per_span, "Found %zu blocks",
+                  count);
+
+    pool_allocator_destroy(allocator);
+    ck_assert(source.freed == 3);
+}
+END_TEST
+
+/**
+ * Growth needs an initialized span heap, a growth factor of at least one and can't be changed.
+ */
+START_TEST(growth_invalid)
+{
+    const size_t arr[] = {64};
+    pool_growth_t growth = {.growth_factor = 1.0};
+    ck_assert(!pool_set_growth(&growth));
+    ck_assert(!pool_allocator_set_growth(NULL, &growth));
+
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_set_growth(allocator, &growth));
+    ck_assert(pool_allocator_init(allocator, arr, 1));
+    ck_assert(!pool_allocator_set_growth(allocator, &growth));
+    pool_allocator_destroy(allocator);
+
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 1, .layout = POOL_LAYOUT_SPANS};
+    allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    ck_assert(!pool_allocator_set_growth(allocator, NULL));
+    growth.growth_factor = 0.5;
+    ck_assert(!pool_allocator_set_growth(allocator, &growth));
+    growth.growth_factor = 1.0;
+    ck_assert(pool_allocator_set_growth(allocator, &growth));
+
+    // Without a limit, the heap just keeps growing by a heap's worth at a time
+    for (size_t i = 0; i < 3 * HEAP_SIZE_BYTES / arr[0]; i++)
+    {
+        ck_assert(pool_allocator_alloc(allocator, arr[0]) != NULL);
+    }
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.chunk_count >= 2 && info.chunk_bytes == info.chunk_count * HEAP_SIZE_BYTES);
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+typedef struct growth_context
+{
+    pool_allocator_t* allocator;
+    int next_id;
+    size_t corrupted;
+} growth_context_t;
+
+static void* growth_worker(void* arg)
+{
+    growth_context_t* ctx = arg;
+    uint8_t id = (uint8_t)__atomic_add_fetch(&ctx->next_id, 1, __ATOMIC_RELAXED);
+    uint8_t* live[SPANS_SLOTS] = {NULL};
+    size_t sizes[SPANS_SLOTS];
+
+    for (int i = 0; i < THREAD_ITERATIONS; i++)
+    {
+        // Blocks are filled with the thread's id, so a block handed out twice gets overwritten
+        int slot = i % SPANS_SLOTS;
+        for (size_t j = 0; live[slot] != NULL && j < sizes[slot]; j++)
+        {
+            if (live[slot][j] != id)
+            {
+                __atomic_add_fetch(&ctx->corrupted, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        pool_allocator_free(ctx->allocator, live[slot]);
+
+        sizes[slot] = (i / 256) % 2 ? 8 * STRESS_BLOCK_SIZE : 32 * STRESS_BLOCK_SIZE;
+        live[slot] = pool_allocator_alloc(ctx->allocator, sizes[slot]);
+        if (live[slot] != NULL)
+        {
+            memset(live[slot], id, sizes[slot]);
+        }
+    }
+
+    for (int slot = 0; slot < SPANS_SLOTS; slot++)
+    {
+        pool_allocator_free(ctx->allocator, live[slot]);
+    }
+
+    return NULL;
+}
+
+/**
+ * Threads growing the heap while moving spans between pools never share a block.
+ */
+START_TEST(growth_threads)
+{
+    // Without LOCK_FREE the shared pools aren't thread-safe on their own
+    if (!LOCK_FREE)
+    {
+        return;
+    }
+
+    const size_t arr[] = {8 * STRESS_BLOCK_SIZE, 32 * STRESS_BLOCK_SIZE};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    pool_growth_t growth = {.chunk_size = SPAN_SIZE_BYTES * 2, .growth_factor = 1.5,
+                            .max_heap_size = SPANS_HEAP_SIZE * 4};
+    growth_context_t ctx = {.allocator = pool_allocator_create_heap(NULL, GROWTH_HEAP_SIZE)};
+    ck_assert(pool_allocator_init_ex(ctx.allocator, &config));
+    ck_assert(pool_allocator_set_growth(ctx.allocator, &growth));
+
+    pthread_t threads[NUM_THREADS];
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        ck_assert(pthread_create(&threads[t], NULL, growth_worker, &ctx) == 0);
+    }
+
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    ck_assert_msg(ctx.corrupted == 0, "%zu blocks handed out twice", ctx.corrupted);
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(ctx.allocator, &info));
+    ck_assert(info.chunk_count > 0);
+
+    pool_allocator_destroy(ctx.allocator);
+}
+END_TEST
+
+// ================= SIZE CLASS TESTS =====================
+
+/**
+ * Sized frees return blocks to the pool they came from, including blocks that spilled into a larger pool.
+ */
+START_TEST(size_class_free_sized)
+{
+    const size_t arr[] = {8, 24, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+
+    void* ptr = pool_allocator_alloc(allocator, 20);
+    ck_assert(ptr != NULL);
+    pool_allocator_free_sized(allocator, ptr, 20);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, 24), ptr);
+
+    // Exhaust the 24-byte pool so the next 20-byte block spills over
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+    }
+    uint8_t* spilled = pool_allocator_alloc(allocator, 20);
+    ck_assert(spilled != NULL);
+    ck_assert(spilled >= (uint8_t*)ptr + pool_size_bytes(3));
+
+    pool_allocator_free_sized(allocator, spilled, 20);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) == NULL);
+    ck_assert_ptr_eq(pool_allocator_alloc_class(allocator, 2), spilled);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Class ids resolve once and allocate from exactly that class, never spilling.
+ */
+START_TEST(size_class_alloc_class)
+{
+    const size_t arr[] = {8, 24, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+
+    ck_assert(pool_allocator_size_class(allocator, 1) == 0);
+    ck_assert(pool_allocator_size_class(allocator, 20) == 1);
+    ck_assert(pool_allocator_size_class(allocator, 64) == 2);
+    ck_assert(pool_allocator_size_class(allocator, 65) == -1);
+    ck_assert(pool_allocator_alloc_class(allocator, 3) == NULL);
+    ck_assert(pool_allocator_alloc_class(allocator, -1) == NULL);
+
+    int class_id = pool_allocator_size_class(allocator, 20);
+    size_t count = 0;
+    void* last = NULL;
+    void* ptr;
+    while ((ptr = pool_allocator_alloc_class(allocator, class_id)) != NULL)
+    {
+        last = ptr;
+        count++;
+    }
+    ck_assert(count == pool_size_bytes(3) / arr[1]);
+
+    // The larger pool is untouched
+    ck_assert(pool_allocator_alloc(allocator, 64) != NULL);
+
+    pool_allocator_free_class(allocator, last, class_id);
+    ck_assert_ptr_eq(pool_allocator_alloc_class(allocator, class_id), last);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Every request size maps onto the smallest fitting pool, including sizes
+ * that share a size-class table granule or straddle the table cutoff.
+ */
+START_TEST(size_class_lookup)
+{
+    const size_t heap_size = 16 * HEAP_SIZE_BYTES;
+    const size_t arr[] = {3, 5, 20, 24, 1000, 1024, 1025, 1500, 4096};
+    const size_t count = sizeof(arr) / sizeof(arr[0]);
+    uint8_t* buffer = malloc(heap_size);
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(buffer, heap_size);
+    ck_assert(pool_allocator_init(allocator, arr, count));
+
+    uint8_t* base = buffer + count * sizeof(pool_header_t);
+    size_t pool_size = heap_pool_size_bytes(heap_size, count);
+    for (size_t n = 1; n <= arr[count - 1] + 1; n++)
+    {
+        size_t expected = 0;
+        while (expected < count && arr[expected] < n)
+        {
+            expected++;
+        }
+
+        uint8_t* ptr = pool_allocator_alloc(allocator, n);
+        if (expected == count)
+        {
+            ck_assert(ptr == NULL);
+            continue;
+        }
+
+        ck_assert(ptr != NULL);
+        ck_assert_msg((size_t)(ptr - base) / pool_size == expected, "Size %zu landed in the wrong pool", n);
+        pool_allocator_free(allocator, ptr);
+    }
+
+    pool_allocator_destroy(allocator);
+    free(buffer);
+}
+END_TEST
+
+/**
+ * Exhausted pools are skipped (and allocations fail) without walking their headers,
+ * and become visible again as soon as one of their blocks is freed.
+ */
+START_TEST(size_class_exhausted_pools)
+{
+    const size_t arr[] = {8, 64, 256};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+
+    uint8_t* last_large = NULL;
+    uint8_t* last_medium = NULL;
+    ck_assert(fill_allocator_pool(allocator, arr[2], NULL, &last_large) > 0);
+    ck_assert(fill_allocator_pool(allocator, arr[1], NULL, &last_medium) > 0);
+
+    // Only the 8-byte pool has room left, and it can't fit anything bigger
+    ck_assert(pool_allocator_alloc(allocator, 9) == NULL);
+    ck_assert(pool_allocator_alloc(allocator, 8) != NULL);
+
+    pool_allocator_free(allocator, last_large);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, 9), last_large);
+    ck_assert(pool_allocator_alloc(allocator, 9) == NULL);
+
+    pool_allocator_free(allocator, last_large);
+    pool_allocator_free(allocator, last_medium);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, 9), last_medium);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, 9), last_large);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= REMOTE FREE TESTS =====================
+
+typedef struct remote_context
+{
+    pool_allocator_t* allocator;
+    void** ptrs;
+    size_t count;
+} remote_context_t;
+
+static void* remote_free_worker(void* arg)
+{
+    remote_context_t* ctx = arg;
+    for (size_t i = 0; i < ctx->count; i++)
+    {
+        pool_allocator_free(ctx->allocator, ctx->ptrs[i]);
+    }
+
+    return NULL;
+}
+
+static void remote_free_all(pool_allocator_t* allocator, void** ptrs, size_t count)
+{
+    remote_context_t ctx = {allocator, ptrs, count};
+    pthread_t thread;
+    pthread_create(&thread, NULL, remote_free_worker, &ctx);
+    pthread_join(thread, NULL);
+}
+
+/**
+ * Blocks freed by a foreign thread stay queued until the owner drains them.
+ */
+START_TEST(remote_free_queue)
+{
+    const size_t arr[] = {8, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+    ck_assert(pool_allocator_set_owner(allocator));
+
+    void* a = pool_allocator_alloc(allocator, 8);
+    ck_assert(a != NULL);
+    remote_free_all(allocator, &a, 1);
+
+    // The pool still has fresh blocks, so nothing is reclaimed yet
+    void* b = pool_allocator_alloc(allocator, 8);
+    ck_assert(b != NULL && b != a);
+
+    ck_assert(pool_allocator_drain_remote_frees(allocator) == 1);
+    ck_assert(pool_allocator_drain_remote_frees(allocator) == 0);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, 8), a);
+
+    // The owner's own frees go straight back to the pool
+    pool_allocator_free(allocator, b);
+    ck_assert_ptr_eq(pool_allocator_alloc(allocator, 8), b);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * An allocation miss drains the queue before spilling into larger pools or failing.
+ */
+START_TEST(remote_free_drain_on_miss)
+{
+    const size_t arr[] = {8, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+    ck_assert(pool_allocator_set_owner(allocator));
+
+    size_t count = pool_size_bytes(2) / aligned(arr[0], sizeof(void*));
+    void** ptrs = malloc(count * sizeof(void*));
+    for (size_t i = 0; i < count; i++)
+    {
+        ptrs[i] = pool_allocator_alloc(allocator, 8);
+        ck_assert(ptrs[i] != NULL);
+    }
+
+    remote_free_all(allocator, ptrs, count);
+
+    // Every block comes back to the 8-byte pool rather than spilling into the 64-byte one
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t* ptr = pool_allocator_alloc(allocator, 8);
+        ck_assert(ptr != NULL);
+        ck_assert(ptr < (uint8_t*)ptrs[0] + pool_size_bytes(2));
+    }
+
+    free(ptrs);
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Owned instances with a thread cache drain the queue when a refill comes up empty.
+ */
+START_TEST(remote_free_thread_cache)
+{
+    const size_t arr[] = {8};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 1));
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+    ck_assert(pool_allocator_set_owner(allocator));
+
+    size_t count = pool_size_bytes(1) / aligned(arr[0], sizeof(void*));
+    void** ptrs = malloc(count * sizeof(void*));
+    for (size_t i = 0; i < count; i++)
+    {
+        ptrs[i] = pool_allocator_alloc(allocator, 8);
+        ck_assert(ptrs[i] != NULL);
+    }
+    ck_assert(pool_allocator_alloc(allocator, 8) == NULL);
+
+    remote_free_all(allocator, ptrs, count);
+    ck_assert(fill_allocator_pool(allocator, 8, NULL, NULL) == count);
+
+    free(ptrs);
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= BULK OPERATION TESTS =====================
+
+static int compare_ptrs(const void* a, const void* b)
+{
+    uintptr_t x = (uintptr_t)*(void* const*)a;
+    uintptr_t y = (uintptr_t)*(void* const*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * A bulk allocation hands out distinct blocks from the fitting pool, fresh or recycled,
+ * and a bulk free makes exactly those blocks available again.
+ */
+START_TEST(bulk_alloc_free)
+{
+    const size_t arr[] = {8, 64};
+    const size_t count = 100;
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    // Mix recycled and fresh blocks in the first batch
+    void* single = pool_allocator_alloc(allocator, 8);
+    pool_allocator_free(allocator, single);
+
+    void* ptrs[100];
+    void* again[100];
+    ck_assert(pool_allocator_alloc_bulk(allocator, 8, count, ptrs) == count);
+    ck_assert_ptr_eq(ptrs[0], single);
+
+    size_t pool_size = pool_size_bytes(2);
+    uint8_t* base = (uint8_t*)single;
+    qsort(ptrs, count, sizeof(void*), compare_ptrs);
+    for (size_t i = 0; i < count; i++)
+    {
+        ck_assert((uint8_t*)ptrs[i] >= base && (uint8_t*)ptrs[i] < base + pool_size);
+        ck_assert(i == 0 || ptrs[i] != ptrs[i - 1]);
+    }
+
+    pool_allocator_free_bulk(allocator, ptrs, count);
+    ck_assert(pool_allocator_alloc_bulk(allocator, 8, count, again) == count);
+    qsort(again, count, sizeof(void*), compare_ptrs);
+    ck_assert(memcmp(ptrs, again, sizeof(ptrs)) == 0);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Bulk allocations spill into larger pools once the fitting one runs out, and return
+ * however many blocks were available once every pool is exhausted.
+ */
+START_TEST(bulk_alloc_spill)
+{
+    const size_t arr[] = {8, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    size_t small = pool_size_bytes(2) / aligned(arr[0], sizeof(void*));
+    size_t large = (HEAP_SIZE_BYTES - 2 * sizeof(pool_header_t) - pool_size_bytes(2)) / arr[1];
+    void** ptrs = malloc((small + large + 1) * sizeof(void*));
+
+    ck_assert(pool_allocator_alloc_bulk(allocator, 8, small + 10, ptrs) == small + 10);
+    ck_assert((uint8_t*)ptrs[small] >= (uint8_t*)ptrs[0] + pool_size_bytes(2));
+    ck_assert(pool_allocator_alloc_bulk(allocator, 8, large, ptrs + small + 10) == large - 10);
+    ck_assert(pool_allocator_alloc(allocator, 8) == NULL);
+
+    pool_allocator_free_bulk(allocator, ptrs, small + large);
+    ck_assert(pool_allocator_alloc_bulk(allocator, 64, large + 1, ptrs) == large);
+
+    free(ptrs);
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+static void* remote_free_bulk_worker(void* arg)
+{
+    remote_context_t* ctx = arg;
+    pool_allocator_free_bulk(ctx->allocator, ctx->ptrs, ctx->count);
+
+    return NULL;
+}
+
+/**
+ * Bulk operations go through the thread cache and the remote-free queue when enabled.
+ */
+START_TEST(bulk_thread_cache)
+{
+    const size_t arr[] = {8};
+    const size_t count = 32;
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 1));
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+    ck_assert(pool_allocator_set_owner(allocator));
+
+    void* ptrs[32];
+    void* cached = pool_allocator_alloc(allocator, 8);
+    pool_allocator_free(allocator, cached);
+
+    // The cached block comes back first
+    ck_assert(pool_allocator_alloc_bulk(allocator, 8, count, ptrs) == count);
+    ck_assert_ptr_eq(ptrs[0], cached);
+
+    // Half the batch is freed by another thread, the rest locally
+    remote_context_t ctx = {allocator, ptrs, count / 2};
+    pthread_t thread;
+    pthread_create(&thread, NULL, remote_free_bulk_worker, &ctx);
+    pthread_join(thread, NULL);
+    pool_allocator_free_bulk(allocator, ptrs + count / 2, count - count / 2);
+    ck_assert(pool_allocator_drain_remote_frees(allocator) == count / 2);
+
+    pool_allocator_flush_thread_cache(allocator);
+    ck_assert(fill_allocator_pool(allocator, 8, NULL, NULL) == pool_size_bytes(1) / aligned(arr[0], sizeof(void*)));
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= ALIGNED ALLOCATION TESTS =====================
+
+/**
+ * Every block of a class meets the class's alignment in every layout, and aligned requests
+ * come from the smallest class that fits and is aligned enough.
+ */
+START_TEST(aligned_classes)
+{
+    const size_t arr[] = {40, 64, 200, 1000};
+    const size_t alignments[] = {0, 64, 32, 0};
+    const pool_layout_t layouts[] = {POOL_LAYOUT_EVEN, POOL_LAYOUT_POW2, POOL_LAYOUT_SPANS, POOL_LAYOUT_COMPACT};
+    for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+    {
+        pool_config_t config = {.block_sizes = arr, .block_size_count = 4, .layout = layouts[l], .alignments = alignments};
+        pool_allocator_t* allocator = pool_allocator_create();
+        ck_assert(pool_allocator_init_ex(allocator, &config));
+
+        // Sizes are rounded up to the alignment, so a 200-byte class aligned to 32 holds 224 bytes
+        ck_assert(pool_allocator_size_class(allocator, 224) == 2);
+        ck_assert(pool_allocator_size_class(allocator, 225) == 3);
+
+        uint8_t* ptr;
+        size_t count = 0;
+        while ((ptr = pool_allocator_alloc_class(allocator, 1)) != NULL)
+        {
+            ck_assert_msg((uintptr_t)ptr % 64 == 0, "Layout %d handed out %p", layouts[l], ptr);
+            count++;
+        }
+        ck_assert(count > 0);
+
+        while ((ptr = pool_allocator_alloc_class(allocator, 2)) != NULL)
+        {
+            ck_assert((uintptr_t)ptr % 32 == 0);
+        }
+
+        pool_allocator_destroy(allocator);
+    }
+}
+END_TEST
+
+/**
+ * pool_alloc_aligned() picks the tightest aligned class, and its blocks are freed like any other.
+ */
+START_TEST(aligned_tightest_class)
+{
+    const size_t arr[] = {40, 64, 200, 1000};
+    const size_t alignments[] = {0, 64, 32, 0};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 4, .alignments = alignments};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+
+    uint8_t* a = pool_allocator_alloc_aligned(allocator, 8, 64);
+    uint8_t* b = pool_allocator_alloc_aligned(allocator, 100, 32);
+    ck_assert_ptr_nonnull(a);
+    ck_assert_ptr_nonnull(b);
+    ck_assert((uintptr_t)a % 64 == 0 && pool_allocator_size_class(allocator, 64) == 1);
+    ck_assert((uintptr_t)b % 32 == 0);
+
+    // Requests too large for any class aligned to 64 fail instead of spilling into an unaligned class
+    ck_assert_ptr_null(pool_allocator_alloc_aligned(allocator, 100, 64));
+    ck_assert_ptr_null(pool_allocator_alloc_aligned(allocator, 8, 128));
+    ck_assert_ptr_null(pool_allocator_alloc_aligned(allocator, 8, 48));
+    ck_assert_ptr_null(pool_allocator_alloc_aligned(allocator, 8, 0));
+    ck_assert_ptr_nonnull(pool_allocator_alloc_aligned(allocator, 8, sizeof(void*)));
+
+    pool_allocator_free(allocator, a);
+    pool_allocator_free(allocator, b);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) == a);
+    ck_assert(pool_allocator_alloc_class(allocator, 2) == b);
+
+    // Once the 64-byte aligned class runs dry, nothing else is aligned enough
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+    }
+    ck_assert_ptr_null(pool_allocator_alloc_aligned(allocator, 8, 64));
+    ck_assert_ptr_nonnull(pool_allocator_alloc_aligned(allocator, 8, 32));
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Alignments must be powers of two that keep the rounded block sizes increasing and fit the layout.
+ */
+START_TEST(aligned_invalid)
+{
+    const size_t arr[] = {40, 64};
+    const size_t odd[] = {0, 48};
+    const size_t overlapping[] = {64, 0};
+    const size_t huge[] = {0, 2 * SPAN_SIZE_BYTES};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .alignments = odd};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+
+    config.alignments = overlapping;
+    allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+
+    config.alignments = huge;
+    config.layout = POOL_LAYOUT_SPANS;
+    allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_init_ex(allocator, &config));
+    pool_allocator_destroy(allocator);
+
+    // Uninitialized instances have nothing to hand out
+    allocator = pool_allocator_create();
+    ck_assert_ptr_null(pool_allocator_alloc_aligned(allocator, 8, 64));
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= REALLOCATION TESTS =====================
+
+/**
+ * Growing within the block already held keeps the pointer, and growing past it
+ * moves the contents into the fitting class with the old block freed.
+ */
+START_TEST(realloc_in_class)
+{
+    const size_t arr[] = {24, 64, 256};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+
+    uint8_t* ptr = pool_allocator_alloc(allocator, 20);
+    ck_assert_ptr_nonnull(ptr);
+    ck_assert(pool_allocator_usable_size(allocator, ptr) == 24);
+    memset(ptr, 0xAB, 20);
+    ck_assert_ptr_eq(pool_allocator_realloc(allocator, ptr, 24), ptr);
+    ck_assert_ptr_eq(pool_allocator_realloc(allocator, ptr, 1), ptr);
+
+    uint8_t* moved = pool_allocator_realloc(allocator, ptr, 100);
+    ck_assert_ptr_nonnull(moved);
+    ck_assert_ptr_ne(moved, ptr);
+    ck_assert(pool_allocator_usable_size(allocator, moved) == 256);
+    for (int i = 0; i < 20; i++)
+    {
+        ck_assert(moved[i] == 0xAB);
+    }
+
+    // The old block went back to its pool
+    ck_assert_ptr_eq(pool_allocator_alloc_class(allocator, 0), ptr);
+
+    // Requests no class fits fail without touching the block
+    ck_assert_ptr_null(pool_allocator_realloc(allocator, moved, 257));
+    ck_assert(moved[0] == 0xAB && pool_allocator_usable_size(allocator, moved) == 256);
+
+    // NULL allocates and 0 frees, like realloc()
+    uint8_t* fresh = pool_allocator_realloc(allocator, NULL, 64);
+    ck_assert(pool_allocator_usable_size(allocator, fresh) == 64);
+    ck_assert_ptr_null(pool_allocator_realloc(allocator, fresh, 0));
+    ck_assert_ptr_eq(pool_allocator_alloc_class(allocator, 1), fresh);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * A block that spilled into a larger class can grow up to that class's block size in place.
+ */
+START_TEST(realloc_spilled)
+{
+    const size_t arr[] = {24, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+    }
+
+    void* ptr = pool_allocator_alloc(allocator, 20);
+    ck_assert_ptr_nonnull(ptr);
+    ck_assert(pool_allocator_usable_size(allocator, ptr) == 64);
+    ck_assert_ptr_eq(pool_allocator_realloc(allocator, ptr, 64), ptr);
+
+    // Pointers outside the heap have no size and can't be resized
+    int local;
+    ck_assert(pool_allocator_usable_size(allocator, &local) == 0);
+    ck_assert_ptr_null(pool_allocator_realloc(allocator, &local, 8));
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= ZEROED ALLOCATION TESTS =====================
+
+/**
+ * Zeroed allocations read back as zeros whether the block is fresh or recycled,
+ * with the instance's heap mmap'd, provided dirty by the caller, or behind a thread cache.
+ */
+START_TEST(calloc_zeroed)
+{
+    const size_t arr[] = {32, 256};
+    static uint8_t buffer[HEAP_SIZE_BYTES];
+    memset(buffer, 0xFF, sizeof(buffer));
+    pool_allocator_t* allocators[] = {pool_allocator_create(), pool_allocator_create_heap(buffer, sizeof(buffer)),
+                                      pool_allocator_create()};
+    for (int a = 0; a < 3; a++)
+    {
+        pool_allocator_t* allocator = allocators[a];
+        ck_assert(pool_allocator_init(allocator, arr, 2));
+        if (a == 2)
+        {
+            ck_assert(pool_allocator_enable_thread_cache(allocator));
+        }
+
+        for (int round = 0; round < 2; round++)
+        {
+            uint8_t* ptrs[8];
+            for (int i = 0; i < 8; i++)
+            {
+                ptrs[i] = pool_allocator_calloc(allocator, 10, 20);
+                ck_assert_ptr_nonnull(ptrs[i]);
+                for (int j = 0; j < 200; j++)
+                {
+                    ck_assert_msg(ptrs[i][j] == 0, "Instance %d, round %d: byte %d is %d", a, round, j, ptrs[i][j]);
+                }
+            }
+
+            // Dirty the blocks so the second round gets them back recycled
+            for (int i = 0; i < 8; i++)
+            {
+                memset(ptrs[i], 0xAB, 256);
+                pool_allocator_free(allocator, ptrs[i]);
+            }
+        }
+
+        pool_allocator_destroy(allocator);
+    }
+}
+END_TEST
+
+/**
+ * Overflowing or empty requests fail like calloc().
+ */
+START_TEST(calloc_invalid)
+{
+    const size_t arr[] = {32, 256};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert_ptr_null(pool_allocator_calloc(allocator, 1, 8));
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    ck_assert_ptr_null(pool_allocator_calloc(allocator, SIZE_MAX / 2, 4));
+    ck_assert_ptr_null(pool_allocator_calloc(allocator, 0, 8));
+    ck_assert_ptr_null(pool_allocator_calloc(allocator, 8, 0));
+    ck_assert_ptr_null(pool_allocator_calloc(allocator, 1, 257));
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= BLOCK SPLITTING TESTS =====================
+
+#define SPLIT_HEAP_SIZE 16384
+
+/**
+ * Once the small pool runs dry, a single large block is split into small blocks instead of
+ * every small request taking a large block of its own, and the pieces find their way back.
+ */
+START_TEST(split_small_class)
+{
+    const size_t arr[] = {16, 2048};
+    const size_t pieces = 2048 / 16;
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, SPLIT_HEAP_SIZE);
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+    size_t large_blocks = heap_pool_size_bytes(SPLIT_HEAP_SIZE, 2) / arr[1];
+
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+    }
+
+    // Every small request now spills, and is split off the first large block
+    ck_assert(pool_allocator_enable_splitting(allocator));
+    ck_assert(!pool_allocator_enable_splitting(allocator));
+    uint8_t* ptrs[2048 / 16];
+    for (size_t i = 0; i < pieces; i++)
+    {
+        ptrs[i] = pool_allocator_alloc(allocator, arr[0]);
+        ck_assert_ptr_nonnull(ptrs[i]);
+        ck_assert(ptrs[i] >= ptrs[0] && ptrs[i] < ptrs[0] + arr[1]);
+    }
+    ck_assert(pool_allocator_size_class(allocator, arr[0]) == 0);
+
+    // The pieces go back to the small class however they're freed
+    pool_allocator_free(allocator, ptrs[0]);
+    pool_allocator_free_sized(allocator, ptrs[1], arr[0]);
+    pool_allocator_free_class(allocator, ptrs[2], 0);
+    pool_allocator_free_bulk(allocator, (void**)ptrs + 3, 2);
+    for (int i = 0; i < 5; i++)
+    {
+        ck_assert_ptr_nonnull(pool_allocator_alloc_class(allocator, 0));
+    }
+    ck_assert_ptr_null(pool_allocator_alloc_class(allocator, 0));
+
+    // Only one large block went to the small class
+    size_t large = 0;
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+        large++;
+    }
+    ck_assert_msg(large == large_blocks - 1, "Found %zu of %zu large blocks", large, large_blocks);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Blocks that don't make at least two pieces still spill whole, and pieces aren't split again.
+ */
+START_TEST(split_no_resplit)
+{
+    const size_t arr[] = {16, 24, 128, 2048};
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, SPLIT_HEAP_SIZE);
+    ck_assert(pool_allocator_init(allocator, arr, 4));
+    ck_assert(pool_allocator_enable_splitting(allocator));
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+    }
+    while (pool_allocator_alloc_class(allocator, 2) != NULL)
+    {
+    }
+
+    // A 24-byte block can't hold two 16-byte ones
+    uint8_t* whole = pool_allocator_alloc(allocator, arr[0]);
+    ck_assert_ptr_nonnull(whole);
+    pool_allocator_free(allocator, whole);
+    ck_assert(pool_allocator_alloc_class(allocator, 1) == whole);
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+    }
+
+    // A 2048-byte block is split into 128-byte ones
+    uint8_t* piece = pool_allocator_alloc(allocator, arr[2]);
+    ck_assert_ptr_nonnull(piece);
+    for (size_t i = 1; i < arr[3] / arr[2]; i++)
+    {
+        ck_assert_ptr_nonnull(pool_allocator_alloc_class(allocator, 2));
+    }
+    ck_assert_ptr_null(pool_allocator_alloc_class(allocator, 2));
+
+    // Which then spill whole into 16-byte requests rather than being split once more
+    pool_allocator_free(allocator, piece);
+    ck_assert(pool_allocator_alloc(allocator, arr[0]) == piece);
+    pool_allocator_free_sized(allocator, piece, arr[0]);
+    ck_assert(pool_allocator_alloc_class(allocator, 2) == piece);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Splitting needs an initialized instance without spans.
+ */
+START_TEST(split_invalid)
+{
+    const size_t arr[] = {64, 512};
+    ck_assert(!pool_allocator_enable_splitting(NULL));
+
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_enable_splitting(allocator));
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    ck_assert(!pool_allocator_enable_splitting(allocator));
+    pool_allocator_destroy(allocator);
+
+    ck_assert(!pool_enable_splitting());
+}
+END_TEST
+
+// ================= STATISTICS TESTS =====================
+
+/**
+ * Allocations, frees, peaks, spills and failures are counted against the pool they happened in.
+ */
+START_TEST(stats_counts)
+{
+    const size_t arr[] = {16, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    pool_stats_t stats;
+    if (!POOL_STATS)
+    {
+        ck_assert(!pool_allocator_get_stats(allocator, &stats));
+        pool_allocator_destroy(allocator);
+        return;
+    }
+
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.num_classes == 2 && stats.block_sizes[1] == 64);
+    ck_assert(stats.allocs[0] == 0 && stats.peak_live[0] == 0);
+
+    void* ptrs[3];
+    for (int i = 0; i < 3; i++)
+    {
+        ptrs[i] = pool_allocator_alloc(allocator, 10);
+    }
+    pool_allocator_free(allocator, ptrs[1]);
+
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.allocs[0] == 3 && stats.frees[0] == 1 && stats.live[0] == 2 && stats.peak_live[0] == 3);
+    ck_assert(stats.initialized[0] >= 3);
+
+    // Drain the smallest pool, so the next 16-byte request spills and the next class-0 request fails
+    size_t drained = 0;
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+        drained++;
+    }
+    ck_assert_ptr_nonnull(pool_allocator_alloc(allocator, 16));
+    ck_assert_ptr_null(pool_allocator_alloc(allocator, 65));
+
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.live[0] == 2 + drained && stats.peak_live[0] == stats.live[0]);
+    ck_assert(stats.failures[0] == 1 && stats.spills_in[0] == 0);
+    ck_assert(stats.allocs[1] == 1 && stats.spills_in[1] == 1 && stats.failures[1] == 0);
+    ck_assert(stats.oversized == 1);
+
+    // With both pools dry, a 16-byte request fails against the class it fits
+    while (pool_allocator_alloc_class(allocator, 1) != NULL)
+    {
+    }
+    ck_assert_ptr_null(pool_allocator_alloc(allocator, 16));
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.failures[0] == 2 && stats.failures[1] == 1);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Bulk operations count every block, and blocks held by a thread cache count as live until flushed.
+ */
+START_TEST(stats_bulk_and_cache)
+{
+    const size_t arr[] = {16, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+
+    pool_stats_t stats;
+    void* ptrs[10];
+    ck_assert(pool_allocator_alloc_bulk(allocator, 16, 10, ptrs) == 10);
+    pool_allocator_free_bulk(allocator, ptrs, 10);
+    if (!POOL_STATS)
+    {
+        ck_assert(!pool_allocator_get_stats(allocator, &stats));
+        pool_allocator_destroy(allocator);
+        return;
+    }
+
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.allocs[0] == 10 && stats.frees[0] == 10 && stats.live[0] == 0 && stats.peak_live[0] == 10);
+
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+    void* ptr = pool_allocator_alloc(allocator, 64);
+    ck_assert_ptr_nonnull(ptr);
+    pool_allocator_free(allocator, ptr);
+
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.live[1] >= 1);
+
+    pool_allocator_flush_thread_cache(allocator);
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert(stats.live[1] == 0 && stats.allocs[1] == stats.frees[1]);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Requests larger than every class are counted as oversized when they go through the thread cache too.
+ */
+START_TEST(stats_cache_oversized)
+{
+    const size_t arr[] = {16, 64};
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+    ck_assert(pool_allocator_enable_thread_cache(allocator));
+
+    void* ptrs[3];
+    ck_assert_ptr_null(pool_allocator_alloc(allocator, 65));
+    ck_assert_ptr_null(pool_allocator_calloc(allocator, 2, 64));
+    ck_assert(pool_allocator_alloc_bulk(allocator, 128, 3, ptrs) == 0);
+
+    pool_stats_t stats;
+    if (!POOL_STATS)
+    {
+        ck_assert(!pool_allocator_get_stats(allocator, &stats));
+        pool_allocator_destroy(allocator);
+        return;
+    }
+
+    ck_assert(pool_allocator_get_stats(allocator, &stats));
+    ck_assert_msg(stats.oversized == 5, "Counted %llu oversized requests", (unsigned long long)stats.oversized);
+    ck_assert(stats.failures[0] == 0 && stats.failures[1] == 0);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+// ================= TRACING TESTS =====================
+
+/**
+ * Read a trace file back into `header` and `events` (up to `max` of them), returning the number of events read.
+ */
+static size_t read_trace(const char* path, pool_trace_header_t* header, pool_trace_event_t* events, size_t max)
+{
+    FILE* file = fopen(path, "rb");
+    ck_assert_ptr_nonnull(file);
+    ck_assert(fread(header, sizeof(*header), 1, file) == 1);
+    size_t count = fread(events, sizeof(*events), max, file);
+    fclose(file);
+    return count;
+}
+
+/**
+ * Allocations, spills, frees and failures are traced in order with their pool and offset.
+ */
+START_TEST(trace_events)
+{
+    const size_t arr[] = {16, 64};
+    char path[] = "/tmp/pool_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert(fd >= 0);
+    close(fd);
+
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(!pool_allocator_enable_trace(allocator, 8, NULL));
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+    ck_assert(pool_allocator_enable_trace(allocator, 8, NULL));
+    ck_assert(!pool_allocator_enable_trace(allocator, 8, NULL));
+
+    uint8_t* small = pool_allocator_alloc(allocator, 10);
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+    }
+    ck_assert(pool_allocator_dump_trace(allocator, path));
+
+    pool_trace_header_t header;
+    pool_trace_event_t events[8];
+    size_t count = read_trace(path, &header, events, 8);
+    ck_assert(memcmp(header.magic, "PTRC", 4) == 0 && header.version == POOL_TRACE_VERSION);
+    ck_assert(header.event_size == sizeof(pool_trace_event_t) && header.num_pools == 2 && header.block_sizes[1] == 64);
+    ck_assert(count == 8 && header.num_events == 8 && header.dropped_events > 0);
+
+    // The ring kept the newest events, ending with the failed class allocation
+    ck_assert(events[7].op == POOL_TRACE_FAIL && events[7].pool_index == 0 && events[7].offset == POOL_TRACE_NO_OFFSET);
+    ck_assert(events[6].op == POOL_TRACE_ALLOC && events[6].pool_index == 0 && events[6].size == 16);
+    ck_assert(events[6].time >= events[0].time);
+
+    uint8_t* spilled = pool_allocator_alloc(allocator, 12);
+    pool_allocator_free(allocator, small);
+    ck_assert_ptr_null(pool_allocator_alloc(allocator, 1000));
+    ck_assert(pool_allocator_dump_trace(allocator, path));
+    count = read_trace(path, &header, events, 8);
+    ck_assert(count == 8);
+
+    // Offsets are relative to the same heap start
+    ck_assert(events[5].op == (POOL_TRACE_ALLOC | POOL_TRACE_SPILL) && events[5].pool_index == 1);
+    ck_assert(events[6].op == POOL_TRACE_FREE && events[6].pool_index == 0 && events[6].size == 0);
+    ck_assert(events[5].size == 12 && spilled - small == (ptrdiff_t)events[5].offset - (ptrdiff_t)events[6].offset);
+    ck_assert(events[7].op == POOL_TRACE_FAIL && events[7].pool_index == POOL_TRACE_NO_POOL && events[7].size == 1000);
+
+    // A bulk allocation is traced against each pool it took blocks from
+    void* ptrs[3];
+    ck_assert(pool_allocator_alloc_bulk(allocator, 10, 3, ptrs) == 3);
+    ck_assert(pool_allocator_dump_trace(allocator, path));
+    count = read_trace(path, &header, events, 8);
+    ck_assert(count == 8);
+    ck_assert(events[5].op == POOL_TRACE_ALLOC && events[5].pool_index == 0 && (uint8_t*)ptrs[0] == small);
+    ck_assert(events[6].op == (POOL_TRACE_ALLOC | POOL_TRACE_SPILL) && events[6].pool_index == 1);
+    ck_assert(events[7].op == (POOL_TRACE_ALLOC | POOL_TRACE_SPILL) && events[7].pool_index == 1);
+
+    pool_allocator_destroy(allocator);
+    unlink(path);
+}
+END_TEST
+
+/**
+ * A failed allocation dumps the ring to the failure path, and only dumps again once the ring has turned over.
+ */
+START_TEST(trace_failure_dump)
+{
+    const size_t arr[] = {16, 64};
+    char path[] = "/tmp/pool_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert(fd >= 0);
+    close(fd);
+    unlink(path);
+
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 2));
+    ck_assert(pool_allocator_enable_trace(allocator, 4, path));
+
+    ck_assert_ptr_nonnull(pool_allocator_alloc(allocator, 8));
+    ck_assert(access(path, F_OK) != 0);
+    ck_assert_ptr_null(pool_allocator_alloc(allocator, 100));
+
+    pool_trace_header_t header;
+    pool_trace_event_t events[4];
+    ck_assert(read_trace(path, &header, events, 4) == 2);
+    ck_assert(events[0].op == POOL_TRACE_ALLOC && events[1].op == POOL_TRACE_FAIL);
+    unlink(path);
+
+    // Failing again right away doesn't rewrite the same events
+    ck_assert_ptr_null(pool_allocator_alloc(allocator, 100));
+    ck_assert(access(path, F_OK) != 0);
+    for (int i = 0; i < 3; i++)
+    {
+        ck_assert_ptr_null(pool_allocator_alloc(allocator, 100));
+    }
+    ck_assert(read_trace(path, &header, events, 4) == 4);
+    ck_assert(header.dropped_events == 2);
+
+    pool_allocator_destroy(allocator);
+    unlink(path);
+}
+END_TEST
+
+/**
+ * Blocks of growth chunks are traced by chunk and offset, so every live block keeps a distinct key
+ * and a free names the block its allocation did.
+ */
+START_TEST(trace_growth_chunks)
+{
+    const size_t arr[] = {64, 512};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    pool_growth_t growth = {.chunk_size = GROWTH_HEAP_SIZE, .growth_factor = 1.0,
+                            .max_heap_size = GROWTH_HEAP_SIZE * 3};
+    char path[] = "/tmp/pool_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ck_assert(fd >= 0);
+    close(fd);
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, GROWTH_HEAP_SIZE);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    ck_assert(pool_allocator_set_growth(allocator, &growth));
+    size_t max = GROWTH_HEAP_SIZE * 3 / arr[0];
+    ck_assert(pool_allocator_enable_trace(allocator, max + 3, NULL));
+
+    size_t count = 0;
+    uint8_t** ptrs = malloc(sizeof(uint8_t*) * max);
+    while ((ptrs[count] = pool_allocator_alloc_class(allocator, 0)) != NULL)
+    {
+        count++;
+    }
+    pool_allocator_free(allocator, ptrs[count - 1]);
+    pool_allocator_free(allocator, ptrs[0]);
+
+    pool_layout_info_t info;
+    ck_assert(pool_allocator_layout_info(allocator, &info));
+    ck_assert(info.chunk_count == 2);
+
+    pool_trace_header_t header;
+    pool_trace_event_t* events = malloc(sizeof(pool_trace_event_t) * (max + 3));
+    ck_assert(pool_allocator_dump_trace(allocator, path));
+    ck_assert(read_trace(path, &header, events, max + 3) == count + 3 && header.dropped_events == 0);
+
+    // The heap is region 0 and the chunks follow in the order they were added
+    ck_assert(events[0].op == POOL_TRACE_ALLOC && events[0].chunk == 0);
+    ck_assert(events[count - 1].op == POOL_TRACE_ALLOC && events[count - 1].chunk == 2);
+    for (size_t i = 0; i < count; i++)
+    {
+        ck_assert(events[i].offset != POOL_TRACE_NO_OFFSET && events[i].chunk <= 2);
+        for (size_t j = 0; j < i; j++)
+        {
+            ck_assert(events[i].chunk != events[j].chunk || events[i].offset != events[j].offset);
+            ck_assert(events[i].chunk != events[j].chunk ||
+                      ptrs[i] - ptrs[j] == (ptrdiff_t)events[i].offset - (ptrdiff_t)events[j].offset);
+        }
+    }
+
+    ck_assert(events[count].op == POOL_TRACE_FAIL);
+    ck_assert(events[count + 1].op == POOL_TRACE_FREE && events[count + 1].chunk == 2 &&
+              events[count + 1].offset == events[count - 1].offset);
+    ck_assert(events[count + 2].op == POOL_TRACE_FREE && events[count + 2].chunk == 0 &&
+              events[count + 2].offset == events[0].offset);
+
+    free(events);
+    free(ptrs);
+    pool_allocator_destroy(allocator);
+    unlink(path);
+}
+END_TEST
+
+// ================= PROFILING TESTS =====================
+
+/**
+ * The profile counts requests, spills and peak live blocks by size class.
+ */
+START_TEST(profile_counts)
+{
+    const size_t arr[] = {16, 64, 256};
+    pool_allocator_t* allocator = pool_allocator_create();
+    pool_profile_t profile;
+    ck_assert(!pool_allocator_enable_profiling(allocator));
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+    ck_assert(!pool_allocator_get_profile(allocator, &profile));
+    ck_assert(pool_allocator_enable_profiling(allocator));
+    ck_assert(!pool_allocator_enable_profiling(allocator));
+
+    void* ptrs[10];
+    for (int i = 0; i < 10; i++)
+    {
+        ptrs[i] = pool_allocator_alloc(allocator, 12);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        pool_allocator_free(allocator, ptrs[i]);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        ptrs[i] = pool_allocator_alloc(allocator, 12);
+    }
+    void* medium = pool_allocator_alloc_class(allocator, 1);
+    ck_assert(pool_allocator_alloc(allocator, 1000) == NULL);
+
+    ck_assert(pool_allocator_get_profile(allocator, &profile));
+    ck_assert(profile.requests[0] == 13);
+    ck_assert(profile.requests[1] == 1);
+    ck_assert(profile.peak_live[0] == 10);
+    ck_assert(profile.peak_live[1] == 1);
+    ck_assert(profile.overflows[0] == 0);
+    ck_assert(profile.oversized == 1);
+    pool_allocator_free_sized(allocator, medium, 64);
+
+    // Blocks spilling out of an exhausted class count against it, but are live in the pool they landed in
+    size_t small = 0;
+    while (pool_allocator_alloc_class(allocator, 0) != NULL)
+    {
+        small++;
+    }
+    void* spilled = pool_allocator_alloc(allocator, 16);
+    ck_assert(spilled != NULL);
+    ck_assert(pool_allocator_get_profile(allocator, &profile));
+    ck_assert(profile.requests[0] == 13 + small + 2);
+    ck_assert(profile.overflows[0] == 2);
+    ck_assert(profile.peak_live[0] == 8 + small);
+    ck_assert(profile.peak_live[1] == 1);
+    pool_allocator_free(allocator, spilled);
+    ck_assert(pool_allocator_alloc(allocator, 64) != NULL);
+    ck_assert(pool_allocator_get_profile(allocator, &profile));
+    ck_assert(profile.peak_live[1] == 1);
+
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
+/**
+ * Recommendations fit the observed sizes tightly, and the next allocator built
+ * from them holds the profiled peak without spilling.
+ */
+START_TEST(profile_recommend)
+{
+    const size_t arr[] = {32, 64, 128, 256, 512};
+    pool_allocator_t* allocator = pool_allocator_create();
+    pool_recommendation_t rec;
+    ck_assert(pool_allocator_init(allocator, arr, 5));
+    ck_assert(!pool_allocator_recommend_config(allocator, &rec));
+    ck_assert(pool_allocator_enable_profiling(allocator));
+    ck_assert(!pool_allocator_recommend_config(allocator, &rec));
+
+    // Two sizes sharing a class, and one well below its class
+    const size_t sizes[] = {16, 24, 300};
+    const size_t counts[] = {100, 50, 10};
+    void* ptrs[160];
+    size_t count = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        for (size_t j = 0; j < counts[i]; j++)
+        {
+            ptrs[count] = pool_allocator_alloc(allocator, sizes[i]);
+            ck_assert(ptrs[count++] != NULL);
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        pool_allocator_free(allocator, ptrs[i]);
+    }
+
+    ck_assert(pool_allocator_recommend_config(allocator, &rec));
+    ck_assert(rec.block_size_count == 3);
+    ck_assert(rec.block_sizes[0] == 16 && rec.block_sizes[1] == 24 && rec.block_sizes[2] == 304);
+    ck_assert(rec.block_counts[0] == 100 && rec.block_counts[1] == 50 && rec.block_counts[2] == 10);
+    ck_assert(rec.heap_size == 3 * sizeof(pool_header_t) + 100 * 16 + 50 * 24 + 10 * 304);
+    pool_allocator_destroy(allocator);
+
+    // The recommended pools hold the same peak exactly
+    pool_config_t config = {.block_sizes = rec.block_sizes, .block_size_count = rec.block_size_count,
+                            .capacity = POOL_CAPACITY_BLOCKS, .capacities = rec.block_counts};
+    allocator = pool_allocator_create_heap(NULL, rec.heap_size);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    for (int i = 0; i < 3; i++)
+    {
+        for (size_t j = 0; j < counts[i]; j++)
+        {
+            ck_assert(pool_allocator_alloc_class(allocator, i) != NULL);
+        }
+        ck_assert(pool_allocator_alloc_class(allocator, i) == NULL);
+    }
+    pool_allocator_destroy(allocator);
+}
+END_TEST
+
 // ================ TESTING SUITE DEFINITIONS ==================
 
 Suite* pool_init_suite(void)
@@ -632,6 +3475,140 @@ Suite* pool_alloc_suite(void)
     return s;
 }
 
+Suite* pool_allocator_suite(void)
+{
+    Suite* s;
+    TCase* tc_instance;
+    TCase* tc_heap;
+    TCase* tc_tcache;
+    TCase* tc_lock_free;
+    TCase* tc_bulk;
+    TCase* tc_layout;
+    TCase* tc_size_class;
+    TCase* tc_remote;
+    TCase* tc_profile;
+    TCase* tc_stats;
+    TCase* tc_trace;
+    TCase* tc_growth;
+    TCase* tc_split;
+    TCase* tc_aligned;
+    TCase* tc_realloc;
+    TCase* tc_calloc;
+
+    s = suite_create("PoolAllocator");
+
+    tc_instance = tcase_create("Allocator instances.");
+    tcase_add_test(tc_instance, instance_independent);
+    tcase_add_test(tc_instance, instance_reinit);
+    tcase_add_test(tc_instance, instance_uninitialized);
+    tcase_add_test(tc_instance, instance_default_wrapper);
+    suite_add_tcase(s, tc_instance);
+
+    tc_heap = tcase_create("Runtime-sized heaps.");
+    tcase_add_test(tc_heap, heap_caller_buffer);
+    tcase_add_test(tc_heap, heap_unaligned_buffer);
+    tcase_add_test(tc_heap, heap_mmap_default);
+    tcase_add_test(tc_heap, heap_too_small);
+    tcase_add_test(tc_heap, heap_multi_gigabyte);
+    tcase_add_test(tc_heap, heap_lazy_frontier);
+    suite_add_tcase(s, tc_heap);
+
+    tc_tcache = tcase_create("Thread cache.");
+    tcase_add_test(tc_tcache, tcache_reuse);
+    tcase_add_test(tc_tcache, tcache_threads);
+    tcase_add_test(tc_tcache, tcache_capacity);
+    tcase_add_test(tc_tcache, tcache_flush);
+    suite_add_tcase(s, tc_tcache);
+
+    tc_lock_free = tcase_create("Lock-free pools.");
+    tcase_add_test(tc_lock_free, lock_free_stress);
+    tcase_add_test(tc_lock_free, lock_free_lazy_init);
+    tcase_add_test(tc_lock_free, lock_free_bulk_stress);
+    suite_add_tcase(s, tc_lock_free);
+
+    tc_bulk = tcase_create("Bulk operations.");
+    tcase_add_test(tc_bulk, bulk_alloc_free);
+    tcase_add_test(tc_bulk, bulk_alloc_spill);
+    tcase_add_test(tc_bulk, bulk_thread_cache);
+    suite_add_tcase(s, tc_bulk);
+
+    tc_layout = tcase_create("Pool layouts.");
+    tcase_add_test(tc_layout, layout_even_info);
+    tcase_add_test(tc_layout, layout_pointer_lookup);
+    tcase_add_test(tc_layout, layout_pow2_pools);
+    tcase_add_test(tc_layout, layout_pow2_unaligned);
+    tcase_add_test(tc_layout, layout_weighted_capacity);
+    tcase_add_test(tc_layout, layout_block_counts);
+    tcase_add_test(tc_layout, layout_spans_rebalance);
+    tcase_add_test(tc_layout, layout_spans_partial);
+    tcase_add_test(tc_layout, layout_spans_invalid);
+    tcase_add_test(tc_layout, layout_spans_threads);
+    tcase_add_test(tc_layout, layout_fill_slack);
+    tcase_add_test(tc_layout, layout_compact_pools);
+    tcase_add_test(tc_layout, layout_compact_trailing);
+    suite_add_tcase(s, tc_layout);
+
+    tc_growth = tcase_create("Heap growth.");
+    tcase_add_test(tc_growth, growth_mmap_chunks);
+    tcase_add_test(tc_growth, growth_callback_limits);
+    tcase_add_test(tc_growth, growth_invalid);
+    tcase_add_test(tc_growth, growth_threads);
+    suite_add_tcase(s, tc_growth);
+
+    tc_size_class = tcase_create("Size classes.");
+    tcase_add_test(tc_size_class, size_class_lookup);
+    tcase_add_test(tc_size_class, size_class_exhausted_pools);
+    tcase_add_test(tc_size_class, size_class_free_sized);
+    tcase_add_test(tc_size_class, size_class_alloc_class);
+    suite_add_tcase(s, tc_size_class);
+
+    tc_remote = tcase_create("Remote frees.");
+    tcase_add_test(tc_remote, remote_free_queue);
+    tcase_add_test(tc_remote, remote_free_drain_on_miss);
+    tcase_add_test(tc_remote, remote_free_thread_cache);
+    suite_add_tcase(s, tc_remote);
+
+    tc_aligned = tcase_create("Aligned allocation.");
+    tcase_add_test(tc_aligned, aligned_classes);
+    tcase_add_test(tc_aligned, aligned_tightest_class);
+    tcase_add_test(tc_aligned, aligned_invalid);
+    suite_add_tcase(s, tc_aligned);
+
+    tc_realloc = tcase_create("Reallocation.");
+    tcase_add_test(tc_realloc, realloc_in_class);
+    tcase_add_test(tc_realloc, realloc_spilled);
+    suite_add_tcase(s, tc_realloc);
+
+    tc_calloc = tcase_create("Zeroed allocation.");
+    tcase_add_test(tc_calloc, calloc_zeroed);
+    tcase_add_test(tc_calloc, calloc_invalid);
+    suite_add_tcase(s, tc_calloc);
+
+    tc_split = tcase_create("Block splitting.");
+    tcase_add_test(tc_split, split_small_class);
+    tcase_add_test(tc_split, split_no_resplit);
+    tcase_add_test(tc_split, split_invalid);
+    suite_add_tcase(s, tc_split);
+
+    tc_profile = tcase_create("Profiling.");
+    tcase_add_test(tc_profile, profile_counts);
+    tcase_add_test(tc_profile, profile_recommend);
+    suite_add_tcase(s, tc_profile);
+
+    tc_stats = tcase_create("Statistics.");
+    tcase_add_test(tc_stats, stats_counts);
+    tcase_add_test(tc_stats, stats_bulk_and_cache);
+    tcase_add_test(tc_stats, stats_cache_oversized);
+    suite_add_tcase(s, tc_stats);
+
+    tc_trace = tcase_create("Tracing.");
+    tcase_add_test(tc_trace, trace_events);
+    tcase_add_test(tc_trace, trace_failure_dump);
+    tcase_add_test(tc_trace, trace_growth_chunks);
+    suite_add_tcase(s, tc_trace);
+
+    return s;
+}
 
 // =============== RUN TEST SUITES ================
 
@@ -644,6 +3621,7 @@ int main(void)
     s = pool_init_suite();
     sr = srunner_create(s);
     srunner_add_suite(sr, pool_alloc_suite());
+    srunner_add_suite(sr, pool_allocator_suite());
 
     srunner_run_all(sr, CK_VERBOSE);
     number_failed = srunner_ntests_failed(sr);
@@ -0,0 +1,212 @@
+/**
+ * Trace replay tool test cases, running the pool_replay program on traces recorded or written here.
+ */
+
+#include <check.h>
+#include <config.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "pool_alloc_tests.h"
+#include "../src/pool_alloc.h"
+
+// =============== DEFINITIONS ===================
+
+#ifndef POOL_REPLAY_PATH
+#define POOL_REPLAY_PATH "../src/pool_replay"
+#endif
+
+#define REPLAY_HEAP_SIZE (SPAN_SIZE_BYTES * 4)
+
+/**
+ * Counts from the first line of pool_replay's report.
+ */
+typedef struct replay_summary
+{
+    size_t events;
+    size_t allocations;
+    size_t unmatched_frees;
+    size_t no_offset;
+} replay_summary_t;
+
+// ============= HELPER FUNCTIONS =================
+
+/**
+ * Run pool_replay with `options` on the trace at `path`, returning its exit status.
+ */
+static int run_replay(const char* options, const char* path, replay_summary_t* summary)
+{
+    char command[512];
+    snprintf(command, sizeof(command), "%s %s %s 2>/dev/null", POOL_REPLAY_PATH, options, path);
+    FILE* output = popen(command, "r");
+    ck_assert_ptr_nonnull(output);
+
+    char line[256];
+    memset(summary, 0, sizeof(*summary));
+    if (fgets(line, sizeof(line), output) != NULL)
+    {
+        sscanf(line, "trace: %zu events, %zu allocations, %zu unmatched frees and %zu events without an offset",
+               &summary->events, &summary->allocations, &summary->unmatched_frees, &summary->no_offset);
+    }
+    while (fgets(line, sizeof(line), output) != NULL)
+    {
+    }
+
+    int status = pclose(output);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void temp_path(char* path)
+{
+    int fd = mkstemp(path);
+    ck_assert(fd >= 0);
+    close(fd);
+}
+
+// ================= REPLAY TESTS =====================
+
+/**
+ * A trace of a growable heap replays every allocation and pairs every free with it, chunk blocks included.
+ */
+START_TEST(replay_growth_trace)
+{
+    const size_t arr[] = {64, 512};
+    pool_config_t config = {.block_sizes = arr, .block_size_count = 2, .layout = POOL_LAYOUT_SPANS};
+    pool_growth_t growth = {.chunk_size = REPLAY_HEAP_SIZE, .growth_factor = 1.0,
+                            .max_heap_size = REPLAY_HEAP_SIZE * 3};
+    char path[] = "/tmp/pool_replay_XXXXXX";
+    temp_path(path);
+
+    pool_allocator_t* allocator = pool_allocator_create_heap(NULL, REPLAY_HEAP_SIZE);
+    ck_assert(pool_allocator_init_ex(allocator, &config));
+    ck_assert(pool_allocator_set_growth(allocator, &growth));
+    size_t max = REPLAY_HEAP_SIZE * 3 / arr[0];
+    ck_assert(pool_allocator_enable_trace(allocator, 2 * max + 1, NULL));
+
+    size_t count = 0;
+    void** ptrs = malloc(sizeof(void*) * max);
+    while ((ptrs[count] = pool_allocator_alloc_class(allocator, 0)) != NULL)
+    {
+        count++;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        pool_allocator_free(allocator, ptrs[i]);
+    }
+    ck_assert(pool_allocator_dump_trace(allocator, path));
+    pool_allocator_destroy(allocator);
+    free(ptrs);
+
+    // The failed allocation is replayed as an allocation freed right away
+    replay_summary_t summary;
+    ck_assert(run_replay("-l spans -H 262144", path, &summary) == 0);
+    ck_assert_msg(summary.allocations == count + 1 && summary.events == 2 * (count + 1),
+                  "Replayed %zu events, %zu allocations", summary.events, summary.allocations);
+    ck_assert(summary.unmatched_frees == 0 && summary.no_offset == 0);
+
+    unlink(path);
+}
+END_TEST
+
+/**
+ * Allocations and frees of blocks without an offset are counted and left out instead of being paired up.
+ */
+START_TEST(replay_no_offset_events)
+{
+    char path[] = "/tmp/pool_replay_XXXXXX";
+    temp_path(path);
+
+    pool_trace_header_t header = {
+        .magic = POOL_TRACE_MAGIC,
+        .version = POOL_TRACE_VERSION,
+        .event_size = sizeof(pool_trace_event_t),
+        .num_pools = 1,
+        .num_events = 5,
+        .block_sizes = {16},
+    };
+    pool_trace_event_t events[] = {
+        {.op = POOL_TRACE_ALLOC, .offset = 0, .size = 16},
+        {.op = POOL_TRACE_ALLOC, .offset = POOL_TRACE_NO_OFFSET, .size = 16},
+        {.op = POOL_TRACE_ALLOC, .offset = POOL_TRACE_NO_OFFSET, .size = 16},
+        {.op = POOL_TRACE_FREE, .offset = POOL_TRACE_NO_OFFSET},
+        {.op = POOL_TRACE_FREE, .offset = 0},
+    };
+    FILE* file = fopen(path, "wb");
+    ck_assert_ptr_nonnull(file);
+    ck_assert(fwrite(&header, sizeof(header), 1, file) == 1);
+    ck_assert(fwrite(events, sizeof(events), 1, file) == 1);
+    fclose(file);
+
+    replay_summary_t summary;
+    ck_assert(run_replay("", path, &summary) == 0);
+    ck_assert(summary.events == 2 && summary.allocations == 1);
+    ck_assert(summary.no_offset == 3 && summary.unmatched_frees == 0);
+
+    unlink(path);
+}
+END_TEST
+
+/**
+ * Text traces may reuse ids once freed, frees of unknown ids are skipped and malformed lines are rejected.
+ */
+START_TEST(replay_text_trace)
+{
+    char path[] = "/tmp/pool_replay_XXXXXX";
+    temp_path(path);
+
+    FILE* file = fopen(path, "w");
+    ck_assert_ptr_nonnull(file);
+    fputs("# comment\na 1 10\na 2 100\nf 1\n\na 1 20\nf 3\nf 1\nf 2\n", file);
+    fclose(file);
+
+    replay_summary_t summary;
+    ck_assert(run_replay("-b 16,128", path, &summary) == 0);
+    ck_assert(summary.events == 6 && summary.allocations == 3 && summary.unmatched_frees == 1);
+
+    // Text traces carry no block sizes of their own
+    ck_assert(run_replay("", path, &summary) != 0);
+
+    file = fopen(path, "a");
+    ck_assert_ptr_nonnull(file);
+    fputs("a 4\n", file);
+    fclose(file);
+    ck_assert(run_replay("-b 16,128", path, &summary) != 0);
+
+    unlink(path);
+}
+END_TEST
+
+Suite* pool_replay_suite(void)
+{
+    Suite* s;
+    TCase* tc;
+
+    s = suite_create("PoolReplay");
+
+    tc = tcase_create("Trace replay.");
+    tcase_add_test(tc, replay_growth_trace);
+    tcase_add_test(tc, replay_no_offset_events);
+    tcase_add_test(tc, replay_text_trace);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+// =============== RUN POOL REPLAY TESTS ================
+
+int main(void)
+{
+    int number_failed;
+
+    SRunner* sr = srunner_create(pool_replay_suite());
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -51,4 +51,34 @@ int pool_size_bytes(size_t num_pools)
     return aligned((HEAP_SIZE_BYTES / num_pools) - sizeof(pool_header_t), sizeof(void*));
 }
 
+size_t heap_pool_size_bytes(size_t heap_size, size_t num_pools)
+{
+    return aligned((heap_size / num_pools) - sizeof(pool_header_t), sizeof(void*));
+}
+
+static size_t fill_allocator_pool(pool_allocator_t* allocator, size_t n, uint8_t** first, uint8_t** last)
+{
+    size_t count = 0;
+    while (true)
+    {
+        uint8_t* ptr = (uint8_t*)pool_allocator_alloc(allocator, n);
+        if (ptr == NULL)
+        {
+            break;
+        }
+
+        if (count == 0 && first != NULL)
+        {
+            *first = ptr;
+        }
+        if (last != NULL)
+        {
+            *last = ptr;
+        }
+        count++;
+    }
+
+    return count;
+}
+
 #endif /* POOL_ALLOC_TESTS_H */
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "pool_alloc_tests.h"
 #include "../src/pool_alloc.h"
@@ -64,6 +66,117 @@ START_TEST(alloc_pool_runtime_check)
 }
 END_TEST
 
+// ================= FREE PATH RUNTIME TESTS =====================
+
+#define FREE_RUNS 5
+#define FREE_BATCH 256
+#define FREE_ITERATIONS 20000
+
+typedef enum free_path
+{
+    FREE_POINTER,
+    FREE_SIZED,
+    FREE_CLASS,
+} free_path_t;
+
+static double time_free_path(free_path_t path)
+{
+    const size_t arr[] = {8, 16, 24, 32, 48, 64, 96, 128};
+    const size_t n = 40;
+    pool_allocator_t* allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(allocator, arr, 8));
+    int class_id = pool_allocator_size_class(allocator, n);
+
+    void* ptrs[FREE_BATCH];
+    double elapsed = 0;
+    for (int i = 0; i < FREE_ITERATIONS; i++)
+    {
+        for (int j = 0; j < FREE_BATCH; j++)
+        {
+            ptrs[j] = pool_allocator_alloc_class(allocator, class_id);
+        }
+
+        // Only the frees are timed
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < FREE_BATCH; j++)
+        {
+            switch (path)
+            {
+            case FREE_POINTER:
+                pool_allocator_free(allocator, ptrs[j]);
+                break;
+            case FREE_SIZED:
+                pool_allocator_free_sized(allocator, ptrs[j], n);
+                break;
+            case FREE_CLASS:
+                pool_allocator_free_class(allocator, ptrs[j], class_id);
+                break;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    }
+
+    pool_allocator_destroy(allocator);
+    return elapsed / ((double)FREE_ITERATIONS * FREE_BATCH);
+}
+
+/**
+ * Comparing pool_free() (pointer-to-pool division) against sized and class frees.
+ */
+START_TEST(free_path_runtime_check)
+{
+    printf("free: %.2f ns/op, free_sized: %.2f ns/op, free_class: %.2f ns/op\n",
+           time_free_path(FREE_POINTER), time_free_path(FREE_SIZED), time_free_path(FREE_CLASS));
+    fflush(stdout);
+}
+END_TEST
+
+// ================= FRESH ALLOCATION RUNTIME TESTS =====================
+
+#define FRESH_RUNS 5
+#define FRESH_HEAP_SIZE (64 * HEAP_SIZE_BYTES)
+
+static double time_fresh_alloc(bool by_class)
+{
+    const size_t arr[] = {16, 64, 256};
+    uint8_t* heap = malloc(FRESH_HEAP_SIZE);
+    ck_assert_ptr_nonnull(heap);
+
+    // Fault the heap in up front, so only the allocator itself is timed
+    memset(heap, 0xFF, FRESH_HEAP_SIZE);
+    pool_allocator_t* allocator = pool_allocator_create_heap(heap, FRESH_HEAP_SIZE);
+    ck_assert(pool_allocator_init(allocator, arr, 3));
+
+    size_t count = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < 3; i++)
+    {
+        while ((by_class ? pool_allocator_alloc_class(allocator, i) : pool_allocator_alloc(allocator, arr[i])) != NULL)
+        {
+            count++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pool_allocator_destroy(allocator);
+    free(heap);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / count;
+}
+
+/**
+ * Allocating every never used block of a fresh instance, i.e. the cost of lazy initialization.
+ */
+START_TEST(fresh_alloc_runtime_check)
+{
+    printf("fresh alloc: %.2f ns/op, fresh alloc_class: %.2f ns/op\n", time_fresh_alloc(false), time_fresh_alloc(true));
+    fflush(stdout);
+}
+END_TEST
+
 // ================ RUNTIME TEST SUITE DEFINITION ==================
 
 Suite* pool_alloc_runtime_suite(void)
@@ -77,6 +190,14 @@ Suite* pool_alloc_runtime_suite(void)
     tcase_add_loop_test(tc, alloc_pool_runtime_check, 0, NUM_RUNS);
     suite_add_tcase(s, tc);
 
+    tc = tcase_create("Fresh allocation runtime.");
+    tcase_add_loop_test(tc, fresh_alloc_runtime_check, 0, FRESH_RUNS);
+    suite_add_tcase(s, tc);
+
+    tc = tcase_create("Free path runtime.");
+    tcase_add_loop_test(tc, free_path_runtime_check, 0, FREE_RUNS);
+    suite_add_tcase(s, tc);
+
     return s;
 }
 
@@ -0,0 +1,132 @@
+/**
+ * Tunable block pool allocator concurrency runtime tests.
+ *
+ * Compares the lock-free shared pools against the same pools behind a global mutex.
+ */
+
+#include <check.h>
+#include <config.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pool_alloc_tests.h"
+#include "../src/pool_alloc.h"
+
+// ================= CONCURRENCY RUNTIME TESTS =====================
+
+#define NUM_RUNS 10
+#define NUM_THREADS 4
+#define NUM_OPS 200000
+
+static const size_t concurrent_block_sizes[] = {8, 16, 32, 64, 128, 256};
+
+static pool_allocator_t* g_allocator;
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool g_use_mutex;
+
+static void* concurrent_worker(void* arg)
+{
+    size_t n = concurrent_block_sizes[(uintptr_t)arg % 6];
+    void* live[4] = {NULL};
+
+    for (int i = 0; i < NUM_OPS; i++)
+    {
+        int slot = i % 4;
+        if (g_use_mutex)
+        {
+            pthread_mutex_lock(&g_mutex);
+        }
+
+        pool_allocator_free(g_allocator, live[slot]);
+        live[slot] = pool_allocator_alloc(g_allocator, n);
+
+        if (g_use_mutex)
+        {
+            pthread_mutex_unlock(&g_mutex);
+        }
+    }
+
+    return NULL;
+}
+
+static double run_concurrent(bool use_mutex)
+{
+    g_allocator = pool_allocator_create();
+    ck_assert(pool_allocator_init(g_allocator, concurrent_block_sizes, 6));
+    g_use_mutex = use_mutex;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t threads[NUM_THREADS];
+    for (uintptr_t t = 0; t < NUM_THREADS; t++)
+    {
+        pthread_create(&threads[t], NULL, concurrent_worker, (void*)t);
+    }
+
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pool_allocator_destroy(g_allocator);
+
+    double elapsed = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return elapsed / (2.0 * NUM_THREADS * NUM_OPS);
+}
+
+/**
+ * Alloc/free pairs from several threads straight on the lock-free shared pools.
+ */
+START_TEST(concurrent_lock_free_runtime)
+{
+    printf("lock-free: %.1f ns/op\n", run_concurrent(false));
+    fflush(stdout);
+}
+END_TEST
+
+/**
+ * The same workload with every call serialized by a global mutex.
+ */
+START_TEST(concurrent_mutex_runtime)
+{
+    printf("mutex: %.1f ns/op\n", run_concurrent(true));
+    fflush(stdout);
+}
+END_TEST
+
+// ================ RUNTIME TEST SUITE DEFINITION ==================
+
+Suite* pool_concurrent_runtime_suite(void)
+{
+    Suite* s;
+    TCase* tc;
+
+    s = suite_create("PoolConcurrentRuntime");
+
+    tc = tcase_create("Concurrent allocation runtime.");
+    tcase_add_loop_test(tc, concurrent_lock_free_runtime, 0, NUM_RUNS);
+    tcase_add_loop_test(tc, concurrent_mutex_runtime, 0, NUM_RUNS);
+    suite_add_tcase(s, tc);
+
+    return s;
+}
+
+// =============== RUN POOL CONCURRENT RUNTIME TESTS ================
+
+int main(void)
+{
+    int number_failed;
+
+    SRunner* sr = srunner_create(pool_concurrent_runtime_suite());
+
+    srunner_run_all(sr, CK_VERBOSE);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}